@@ -0,0 +1,635 @@
+// benchmarks for the reader and the writer on generated documents
+// the documents are made by a fixed generator, the bytes are the same on every run and machine
+//
+// build (from the root of the repo):
+//	g++ -O2 -std=c++17 -Isrc src/*.cpp bench/ok_json_bench.cpp -o ok_json_bench -pthread
+//	cl /O2 /std:c++17 /EHsc /Isrc src\*.cpp bench\ok_json_bench.cpp
+//
+// run:
+//	ok_json_bench					a table
+//	ok_json_bench --json			one json object per line (to compare runs with a script)
+//	ok_json_bench --scale 4			documents 4 times as large
+//	ok_json_bench --corpus wide		only one corpus (geometry, social, wide, deep, ndjson)
+//	ok_json_bench --time 0.5		seconds per measurement (the best repetition is kept)
+//
+// measured for every corpus:
+//	parse	Reader::parse in MB/s, the allocations of the first parse and per parse after that
+//		(every heap allocation made by the parse, counted with a replaced operator new)
+//	lookup	get_child by key in ns, every key of every object is looked up
+//	write	the parsed tree written with OkJsonWriter in MB/s (of output)
+// ndjson is parsed line by line with one Reader (allocations are per line) and also with LinesReader on one thread
+
+#include "ok_json_parallel.h"
+#include "ok_json_reader.h"
+#include "ok_json_scan.h"
+#include "ok_json_writer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// counts every allocation of the process, Reader::get_allocation_count only knows the buffers it grew
+// (new[] and the nothrow forms call these)
+std::atomic<int64_t> g_allocations(0);
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* p = malloc(size != 0 ? size : 1);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+using namespace OkJsonReader;
+
+namespace OkJsonBench
+{
+	// splitmix64, the standard distributions are not the same on every library
+	struct Rng
+	{
+		uint64_t _s;
+
+		uint64_t next()
+		{
+			uint64_t z = (_s += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			return z ^ (z >> 31);
+		}
+
+		int range(int n) { return (int)(next() % (uint64_t)n); }
+		double unit() { return (double)(next() >> 11) * (1.0 / 9007199254740992.0); }
+		bool chance(int percent) { return range(100) < percent; }
+	};
+
+	const char* k_words[] =
+	{
+		"the", "json", "parser", "fast", "coffee", "morning", "release", "today", "build", "server",
+		"latency", "again", "weekend", "new", "version", "thanks", "team", "great", "launch", "city",
+	};
+
+	void add_number(std::string& dst, const char* format, double v)
+	{
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), format, v);
+		dst += buffer;
+	}
+
+	void add_int(std::string& dst, int64_t v)
+	{
+		dst += std::to_string(v);
+	}
+
+	void add_text(std::string& dst, Rng& rng, int words)
+	{
+		dst += '"';
+		for (int i = 0; i < words; ++i)
+		{
+			if (i != 0)
+				dst += ' ';
+
+			// some escapes and non-ascii, like real feeds
+			int r = rng.range(40);
+			if (r == 0)
+				dst += "\\u00e9t\\u00e9";
+			else if (r == 1)
+				dst += "\\\"quoted\\\"";
+			else if (r == 2)
+				dst += "\\n";
+			else if (r == 3)
+				dst += "\xe2\x98\x95";
+			else
+				dst += k_words[rng.range(20)];
+		}
+		dst += '"';
+	}
+
+	// number heavy, like canada.json (polygons of coordinate pairs)
+	std::string make_geometry(Rng& rng, int scale)
+	{
+		std::string d = "{\"type\":\"FeatureCollection\",\"features\":[";
+		for (int f = 0; f < 20 * scale; ++f)
+		{
+			if (f != 0)
+				d += ',';
+
+			d += "{\"type\":\"Feature\",\"properties\":{\"name\":\"region ";
+			add_int(d, f);
+			d += "\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[";
+
+			double x = -140.0 + rng.unit() * 80.0;
+			double y = 42.0 + rng.unit() * 30.0;
+			for (int p = 0; p < 2500; ++p)
+			{
+				x += (rng.unit() - 0.5) * 0.01;
+				y += (rng.unit() - 0.5) * 0.01;
+
+				d += p != 0 ? ",[" : "[";
+				add_number(d, "%.15g", x);
+				d += ',';
+				add_number(d, "%.15g", y);
+				d += ']';
+			}
+			d += "]]}}";
+		}
+		d += "]}";
+		return d;
+	}
+
+	// string heavy, a feed of posts with users and entities
+	std::string make_social(Rng& rng, int scale)
+	{
+		std::string d = "{\"statuses\":[";
+		for (int i = 0; i < 1000 * scale; ++i)
+		{
+			if (i != 0)
+				d += ',';
+
+			int64_t id = 505874924095815681LL + rng.range(1000000000);
+			d += "{\"created_at\":\"Sun Aug 31 00:29:15 +0000 2014\",\"id\":";
+			add_int(d, id);
+			d += ",\"id_str\":\"";
+			add_int(d, id);
+			d += "\",\"text\":";
+			add_text(d, rng, 10 + rng.range(30));
+			d += ",\"user\":{\"id\":";
+			add_int(d, rng.range(2000000000));
+			d += ",\"name\":";
+			add_text(d, rng, 2);
+			d += ",\"screen_name\":\"user_";
+			add_int(d, rng.range(100000));
+			d += "\",\"location\":";
+			add_text(d, rng, 1 + rng.range(3));
+			d += ",\"description\":";
+			add_text(d, rng, 5 + rng.range(20));
+			d += ",\"followers_count\":";
+			add_int(d, rng.range(100000));
+			d += ",\"verified\":";
+			d += rng.chance(10) ? "true" : "false";
+			d += ",\"profile_image_url\":\"http:\\/\\/pbs.example.com\\/profile_images\\/";
+			add_int(d, rng.range(1000000000));
+			d += "\\/avatar_normal.png\"},\"entities\":{\"hashtags\":[";
+			int tags = rng.range(4);
+			for (int t = 0; t < tags; ++t)
+			{
+				if (t != 0)
+					d += ',';
+				d += "{\"text\":\"";
+				d += k_words[rng.range(20)];
+				d += "\",\"indices\":[";
+				int at = rng.range(100);
+				add_int(d, at);
+				d += ',';
+				add_int(d, at + 6);
+				d += "]}";
+			}
+			d += "],\"urls\":[]},\"retweet_count\":";
+			add_int(d, rng.range(500));
+			d += ",\"favorited\":false,\"lang\":\"en\",\"in_reply_to_status_id\":";
+			if (rng.chance(30))
+				add_int(d, id - rng.range(100000));
+			else
+				d += "null";
+			d += '}';
+		}
+		d += "]}";
+		return d;
+	}
+
+	// objects with many keys (lookups go through the object index)
+	std::string make_wide(Rng& rng, int scale)
+	{
+		std::string d = "[";
+		for (int i = 0; i < 200 * scale; ++i)
+		{
+			if (i != 0)
+				d += ',';
+
+			d += '{';
+			for (int k = 0; k < 500; ++k)
+			{
+				if (k != 0)
+					d += ',';
+
+				d += "\"field_";
+				add_int(d, k);
+				d += "\":";
+				switch (k % 4)
+				{
+				case 0: add_int(d, rng.range(1000000)); break;
+				case 1: add_number(d, "%.6g", rng.unit() * 1000.0); break;
+				case 2: d += rng.chance(50) ? "true" : "null"; break;
+				default: add_text(d, rng, 1 + rng.range(3)); break;
+				}
+			}
+			d += '}';
+		}
+		d += ']';
+		return d;
+	}
+
+	// deep nesting, objects and arrays in turn
+	std::string make_deep(Rng& rng, int scale)
+	{
+		std::string d = "[";
+		for (int i = 0; i < 2000 * scale; ++i)
+		{
+			if (i != 0)
+				d += ',';
+
+			int depth = 50 + rng.range(100);
+			for (int k = 0; k < depth; ++k)
+				d += (k & 1) ? "[" : "{\"n\":";
+			add_int(d, i);
+			for (int k = depth - 1; k >= 0; --k)
+				d += (k & 1) ? "]" : "}";
+		}
+		d += ']';
+		return d;
+	}
+
+	// newline delimited log records
+	std::string make_ndjson(Rng& rng, int scale)
+	{
+		const char* levels[] = { "debug", "info", "info", "info", "warn", "error" };
+		const char* paths[] = { "/api/v1/users", "/api/v1/orders", "/health", "/api/v2/search", "/static/app.js" };
+
+		std::string d;
+		for (int i = 0; i < 20000 * scale; ++i)
+		{
+			d += "{\"ts\":";
+			add_int(d, 1700000000000LL + i * 37LL);
+			d += ",\"level\":\"";
+			d += levels[rng.range(6)];
+			d += "\",\"msg\":";
+			add_text(d, rng, 3 + rng.range(8));
+			d += ",\"req\":{\"method\":\"GET\",\"path\":\"";
+			d += paths[rng.range(5)];
+			d += "\",\"status\":";
+			add_int(d, rng.chance(95) ? 200 : 500);
+			d += ",\"ms\":";
+			add_number(d, "%.3f", rng.unit() * 250.0);
+			d += "},\"tags\":[\"svc\",\"";
+			d += k_words[rng.range(20)];
+			d += "\"]}\n";
+		}
+		return d;
+	}
+
+	////////////////////////////////////////////////////////////////
+
+	struct Settings
+	{
+		int _scale = 1;
+		double _time = 0.25;
+		bool _json = false;
+		const char* _corpus = nullptr;
+	};
+
+	double now()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// runs f until the time is used (at least 3 times), returns the fastest run in seconds
+	template<typename F>
+	double best_time(const Settings& settings, F f)
+	{
+		double best = 1e30;
+		double total = 0.0;
+		for (int reps = 0; reps < 3 || total < settings._time; ++reps)
+		{
+			double t = now();
+			f();
+			t = now() - t;
+
+			if (t < best)
+				best = t;
+			total += t;
+		}
+		return best;
+	}
+
+	// count is bytes (parse, write) or lookups, allocations are only known for parses (-1 otherwise)
+	void report(const Settings& settings, const char* corpus, const char* bench, double value, const char* unit, size_t count, double allocations_first = -1.0, double allocations_per_doc = -1.0)
+	{
+		const char* count_unit = strcmp(bench, "lookup") == 0 ? "lookups" : "bytes";
+
+		if (settings._json)
+		{
+			printf("{\"corpus\":\"%s\",\"bench\":\"%s\",\"value\":%.3f,\"unit\":\"%s\",\"%s\":%zu",
+				corpus, bench, value, unit, count_unit, count);
+			if (allocations_first >= 0.0)
+				printf(",\"allocations_first\":%.0f,\"allocations_per_doc\":%.3f", allocations_first, allocations_per_doc);
+			printf("}\n");
+			return;
+		}
+
+		printf("%-10s %-8s %10.2f %-6s %10zu %s", corpus, bench, value, unit, count, count_unit);
+		if (allocations_first >= 0.0)
+			printf(", allocations first %.0f then %.3f per doc", allocations_first, allocations_per_doc);
+		printf("\n");
+	}
+
+	// every key of every object, with the object it is in
+	struct Lookup
+	{
+		Proxy _object;
+		HashedKeyStripped _key;
+	};
+
+	void collect_lookups(const Proxy& p, std::vector<Lookup>& lookups)
+	{
+		Type t = p.debug_get_type();
+		if (t != e_object && t != e_array)
+			return;
+
+		int size = p.size();
+		for (int i = 0; i < size; ++i)
+		{
+			if (t == e_object)
+			{
+				TextSpan k = p.get_key(i);
+				int32_t s = (int32_t)(k._e - k._b);
+				lookups.push_back({ p, { key_hash(k._b, s), s } });
+			}
+
+			collect_lookups(p.get_child(i), lookups);
+		}
+	}
+
+	// the writer has no null, false is written instead (the same number of bytes as is fine here)
+	void write_value(OkJsonWriter::Proxy& parent, const Proxy& v, const char* key, std::string& buffer)
+	{
+		switch (v.debug_get_type())
+		{
+		case e_object:
+		case e_array:
+			{
+				bool object = v.debug_get_type() == e_object;
+				OkJsonWriter::Proxy child(parent.get_writer(), object ? OkJsonWriter::e_object : OkJsonWriter::e_array, key);
+				for (int i = 0; i < v.size(); ++i)
+				{
+					const char* child_key = nullptr;
+					std::string key_buffer;
+					if (object)
+					{
+						TextSpan k = v.get_key(i);
+						key_buffer.assign(k._b, k._e);
+						child_key = key_buffer.c_str();
+					}
+					write_value(child, v.get_child(i), child_key, buffer);
+				}
+			}
+			break;
+
+		case e_int:
+			{
+				int64_t i = 0;
+				v.try_get(i);
+				if (i >= INT32_MIN && i <= INT32_MAX)
+					parent.add((int)i, key);
+				else
+					parent.add((double)i, key);
+			}
+			break;
+
+		case e_number:
+			{
+				double d = 0.0;
+				v.try_get(d);
+				parent.add(d, key);
+			}
+			break;
+
+		case e_string:
+			{
+				// still escaped, written as it is
+				TextSpan t;
+				v.try_get(t);
+				buffer.assign(t._b, t._e);
+				parent.add(buffer.c_str(), key);
+			}
+			break;
+
+		case e_true: parent.add(true, key); break;
+		case e_false:
+		case e_null: parent.add(false, key); break;
+		}
+	}
+
+	size_t write_tree(const Proxy& root)
+	{
+		OkJsonWriter::Writer writer;
+		std::string buffer;
+		{
+			// the root is written as the only element of an array (the writer starts with a container)
+			OkJsonWriter::Proxy top(writer, OkJsonWriter::e_array);
+			write_value(top, root, nullptr, buffer);
+		}
+		return writer._dest.size();
+	}
+
+	void bench_lookups(const Settings& settings, const char* corpus, const std::vector<Lookup>& lookups)
+	{
+		int found = 0;
+		double t = best_time(settings, [&]()
+		{
+			for (const Lookup& l : lookups)
+				found += l._object.get_child(l._key).debug_get_type() != e_null;
+		});
+
+		if (found == 0 && !lookups.empty())
+			printf("%s: no keys found\n", corpus);
+
+		report(settings, corpus, "lookup", t * 1e9 / (double)(lookups.size() ? lookups.size() : 1), "ns", lookups.size());
+	}
+
+	int64_t allocation_count()
+	{
+		return g_allocations.load(std::memory_order_relaxed);
+	}
+
+	void bench_document(const Settings& settings, const char* corpus, const std::string& doc)
+	{
+		Reader reader;
+		std::string error;
+		int64_t allocations = allocation_count();
+		if (!reader.parse(doc.c_str(), (int)doc.size(), &error))
+		{
+			printf("%s: %s\n", corpus, error.c_str());
+			exit(1);
+		}
+
+		double allocations_first = (double)(allocation_count() - allocations);
+		int parses = 0;
+		allocations = allocation_count();
+		double t = best_time(settings, [&]()
+		{
+			reader.parse(doc.c_str(), (int)doc.size(), &error);
+			++parses;
+		});
+		double allocations_per_doc = (double)(allocation_count() - allocations) / parses;
+		report(settings, corpus, "parse", (double)doc.size() / t / 1e6, "MB/s", doc.size(), allocations_first, allocations_per_doc);
+
+		std::vector<Lookup> lookups;
+		collect_lookups(reader.get_root(), lookups);
+		bench_lookups(settings, corpus, lookups);
+
+		size_t written = 0;
+		t = best_time(settings, [&]()
+		{
+			written = write_tree(reader.get_root());
+		});
+		report(settings, corpus, "write", (double)written / t / 1e6, "MB/s", written);
+	}
+
+	// every line is a document, parsed one by one with the same reader (and all at once with LinesReader)
+	void bench_lines(const Settings& settings, const char* corpus, const std::string& doc)
+	{
+		std::vector<size_t> starts;
+		for (size_t at = 0; at < doc.size(); )
+		{
+			starts.push_back(at);
+			const char* nl = (const char*)memchr(doc.data() + at, '\n', doc.size() - at);
+			at = nl != nullptr ? (size_t)(nl - doc.data()) + 1 : doc.size();
+		}
+		starts.push_back(doc.size());
+
+		Reader reader;
+		std::string error;
+		auto parse_all = [&]()
+		{
+			for (size_t i = 0; i + 1 < starts.size(); ++i)
+				reader.parse(doc.c_str() + starts[i], (int)(starts[i + 1] - starts[i]), &error);
+		};
+
+		int64_t allocations = allocation_count();
+		parse_all();
+		double allocations_first = (double)(allocation_count() - allocations);
+		int passes = 0;
+		allocations = allocation_count();
+		double t = best_time(settings, [&]()
+		{
+			parse_all();
+			++passes;
+		});
+		double documents = (double)passes * (double)(starts.size() - 1);
+		double allocations_per_doc = (double)(allocation_count() - allocations) / documents;
+		report(settings, corpus, "parse", (double)doc.size() / t / 1e6, "MB/s", doc.size(), allocations_first, allocations_per_doc);
+
+		LinesReader lines;
+		lines.set_thread_count(1);
+		t = best_time(settings, [&]()
+		{
+			lines.parse(doc.c_str(), (int)doc.size(), &error);
+		});
+		report(settings, corpus, "lines", (double)doc.size() / t / 1e6, "MB/s", doc.size());
+
+		std::vector<Lookup> lookups;
+		for (int i = 0; i < lines.size(); ++i)
+			collect_lookups(lines.get_root(i), lookups);
+		bench_lookups(settings, corpus, lookups);
+
+		size_t written = 0;
+		t = best_time(settings, [&]()
+		{
+			written = 0;
+			for (int i = 0; i < lines.size(); ++i)
+				written += write_tree(lines.get_root(i));
+		});
+		report(settings, corpus, "write", (double)written / t / 1e6, "MB/s", written);
+	}
+
+	const char* isa_name()
+	{
+		switch (OkJsonScan::get_isa())
+		{
+		case OkJsonScan::e_avx2: return "avx2";
+		case OkJsonScan::e_sse2: return "sse2";
+		default: return "scalar";
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	using namespace OkJsonBench;
+
+	Settings settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--json") == 0)
+			settings._json = true;
+		else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+			settings._scale = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+			settings._time = atof(argv[++i]);
+		else if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc)
+			settings._corpus = argv[++i];
+		else
+		{
+			printf("usage: ok_json_bench [--json] [--scale n] [--time seconds] [--corpus geometry|social|wide|deep|ndjson]\n");
+			return 1;
+		}
+	}
+
+	if (settings._scale < 1)
+		settings._scale = 1;
+
+	if (settings._json)
+		printf("{\"isa\":\"%s\",\"scale\":%d}\n", isa_name(), settings._scale);
+	else
+		printf("isa %s, scale %d\n", isa_name(), settings._scale);
+
+	struct Corpus
+	{
+		const char* _name;
+		std::string (*_make)(Rng& rng, int scale);
+		bool _lines;
+	};
+
+	const Corpus corpora[] =
+	{
+		{ "geometry", make_geometry, false },
+		{ "social", make_social, false },
+		{ "wide", make_wide, false },
+		{ "deep", make_deep, false },
+		{ "ndjson", make_ndjson, true },
+	};
+
+	for (const Corpus& c : corpora)
+	{
+		if (settings._corpus != nullptr && strcmp(settings._corpus, c._name) != 0)
+			continue;
+
+		// every corpus has its own seed, so one can be run alone and give the same bytes
+		Rng rng { 0x6f6b5f6a736f6eULL ^ (uint64_t)strlen(c._name) * 0x100000001b3ULL ^ (uint64_t)c._name[0] };
+		std::string doc = c._make(rng, settings._scale);
+
+		if (c._lines)
+			bench_lines(settings, c._name, doc);
+		else
+			bench_document(settings, c._name, doc);
+	}
+
+	return 0;
+}
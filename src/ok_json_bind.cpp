@@ -0,0 +1,468 @@
+#include "ok_json_bind.h"
+#include "ok_json_internal.h"
+#include "ok_json_number.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace OkJsonBind
+{
+	using namespace OkJsonReader;
+	using namespace OkJsonReader_Private;
+
+	Decoder::Decoder(const char* text, int size)
+	{
+		_text = text;
+		_size = size < 0 ? (int32_t)strlen(text) : size;
+	}
+
+	void Decoder::skip_ws()
+	{
+		while (_at < _size)
+		{
+			char c = _text[_at];
+			if (is_ws(c))
+			{
+				++_at;
+				continue;
+			}
+
+			if (c != '/')
+				return;
+
+			// comment
+			if (_at + 1 >= _size || _text[_at + 1] != '/')
+			{
+				fail("comment starts with //");
+				return;
+			}
+
+			while (_at < _size && _text[_at] != '\n' && _text[_at] != '\r')
+				++_at;
+		}
+	}
+
+	bool Decoder::at_end()
+	{
+		skip_ws();
+		return _at >= _size;
+	}
+
+	bool Decoder::fail(const char* desc)
+	{
+		if (_error.empty())
+		{
+			TextSpan full(_text, _text + _size);
+			TextSpan read(_text + _at, _text + _size);
+			line_and_col_to_string(full, read, _error, desc);
+		}
+
+		// nothing more is read
+		_at = _size;
+		return false;
+	}
+
+	bool Decoder::read_literal(const char* word, int32_t size)
+	{
+		if (_size - _at < size || memcmp(_text + _at, word, (size_t)size) != 0)
+			return fail("invalid value");
+
+		_at += size;
+		return true;
+	}
+
+	bool Decoder::read_raw_string(TextSpan& v, bool& escaped)
+	{
+		skip_ws();
+		if (_at >= _size || _text[_at] != '"')
+			return fail("expecting string");
+
+		int32_t b = _at + 1;
+		int32_t p = b;
+		escaped = false;
+		for (;;)
+		{
+			const char* quote = (const char*)memchr(_text + p, '"', (size_t)(_size - p));
+			if (quote == nullptr)
+				return fail("string needs to end with \"");
+
+			// escaped if after an odd number of backslashes
+			int32_t at = (int32_t)(quote - _text);
+			int32_t backslashes = 0;
+			while (at - backslashes > b && _text[at - backslashes - 1] == '\\')
+				++backslashes;
+
+			if ((backslashes & 1) == 0)
+			{
+				escaped = memchr(_text + b, '\\', (size_t)(at - b)) != nullptr;
+				v = TextSpan(_text + b, _text + at);
+				_at = at + 1;
+				return true;
+			}
+
+			p = at + 1;
+		}
+	}
+
+	bool Decoder::read(bool& v)
+	{
+		skip_ws();
+		if (_at < _size && _text[_at] == 't')
+		{
+			v = true;
+			return read_literal("true", 4);
+		}
+
+		if (_at < _size && _text[_at] == 'f')
+		{
+			v = false;
+			return read_literal("false", 5);
+		}
+
+		return fail("expecting true or false");
+	}
+
+	bool Decoder::read(int64_t& v)
+	{
+		skip_ws();
+		const char* p = _text + _at;
+		OkJsonNumber::Decimal d;
+		if (!OkJsonNumber::scan(p, _text + _size, d))
+			return fail("expecting number");
+
+		_at = (int32_t)(p - _text);
+		if (!OkJsonNumber::to_int64(d, v))
+			return fail("number is not an integer that fits");
+
+		return true;
+	}
+
+	bool Decoder::read(uint64_t& v)
+	{
+		skip_ws();
+		const char* p = _text + _at;
+		OkJsonNumber::Decimal d;
+		if (!OkJsonNumber::scan(p, _text + _size, d))
+			return fail("expecting number");
+
+		_at = (int32_t)(p - _text);
+		if (!OkJsonNumber::to_uint64(d, v))
+			return fail("number is not an integer that fits");
+
+		return true;
+	}
+
+	bool Decoder::read(double& v)
+	{
+		skip_ws();
+		const char* b = _text + _at;
+		const char* p = b;
+		OkJsonNumber::Decimal d;
+		if (!OkJsonNumber::scan(p, _text + _size, d))
+			return fail("expecting number");
+
+		_at = (int32_t)(p - _text);
+		v = OkJsonNumber::to_double(d, b, p);
+		return true;
+	}
+
+	bool Decoder::read(std::string& v)
+	{
+		TextSpan raw;
+		bool escaped;
+		if (!read_raw_string(raw, escaped))
+			return false;
+
+		if (!escaped)
+		{
+			v.assign(raw._b, raw._e);
+			return true;
+		}
+
+		// into v, keeping its capacity
+		v.resize((size_t)(raw._e - raw._b));
+		int size = Proxy::unescape(raw, &v[0]);
+		if (size < 0)
+			return fail("invalid escape code in string");
+
+		v.resize((size_t)size);
+		return true;
+	}
+
+	bool Decoder::begin_object()
+	{
+		skip_ws();
+		if (_at >= _size || _text[_at] != '{')
+			return fail("expecting object");
+
+		++_at;
+		return true;
+	}
+
+	bool Decoder::next_key(int i, uint64_t& h, int32_t& size)
+	{
+		skip_ws();
+		if (_at >= _size)
+			return fail("object needs to end with }");
+
+		if (_text[_at] == '}')
+		{
+			++_at;
+			return false;
+		}
+
+		if (i != 0)
+		{
+			if (_text[_at] != ',')
+				return fail("need \",\" between key-values");
+
+			// trailing comma
+			++_at;
+			skip_ws();
+			if (_at < _size && _text[_at] == '}')
+			{
+				++_at;
+				return false;
+			}
+		}
+
+		TextSpan key;
+		bool escaped;
+		if (!read_raw_string(key, escaped))
+			return false;
+
+		// keys are matched with their escape codes (like HashedKey)
+		size = (int32_t)(key._e - key._b);
+		h = key_hash(key._b, size);
+
+		skip_ws();
+		if (_at >= _size || _text[_at] != ':')
+			return fail("need \":\" after key");
+
+		++_at;
+		return true;
+	}
+
+	bool Decoder::begin_array()
+	{
+		skip_ws();
+		if (_at >= _size || _text[_at] != '[')
+			return fail("expecting array");
+
+		++_at;
+		return true;
+	}
+
+	bool Decoder::next_element(int i)
+	{
+		skip_ws();
+		if (_at >= _size)
+			return fail("array needs to end with ]");
+
+		if (_text[_at] == ']')
+		{
+			++_at;
+			return false;
+		}
+
+		if (i != 0)
+		{
+			if (_text[_at] != ',')
+				return fail("need \",\" between values");
+
+			// trailing comma
+			++_at;
+			skip_ws();
+			if (_at < _size && _text[_at] == ']')
+			{
+				++_at;
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	bool Decoder::skip_value()
+	{
+		// containers are skipped without recursion, the open ones are kept in _open ('{' or '[')
+		size_t open_base = _open.size();
+		for (;;)
+		{
+			skip_ws();
+			if (_at >= _size)
+				return fail("expecting value");
+
+			bool first = false;
+			char c = _text[_at];
+			if (c == '{' || c == '[')
+			{
+				if ((int32_t)_open.size() >= _max_depth)
+					return fail("nested too deep");
+
+				_open.push_back(c);
+				++_at;
+				first = true;
+			}
+			else if (!skip_scalar())
+			{
+				return false;
+			}
+
+			// at the next child of the container on top, or close it (then it was a child itself)
+			for (;;)
+			{
+				if (_open.size() == open_base)
+					return true;
+
+				uint64_t h;
+				int32_t size;
+				bool more = _open.back() == '{' ? next_key(first ? 0 : 1, h, size) : next_element(first ? 0 : 1);
+				if (failed())
+					return false;
+
+				if (more)
+					break;
+
+				_open.pop_back();
+				first = false;
+			}
+		}
+	}
+
+	bool Decoder::skip_scalar()
+	{
+		switch (_text[_at])
+		{
+		case '"':
+		{
+			TextSpan raw;
+			bool escaped;
+			return read_raw_string(raw, escaped);
+		}
+
+		case 't': return read_literal("true", 4);
+		case 'f': return read_literal("false", 5);
+		case 'n': return read_literal("null", 4);
+		}
+
+		const char* p = _text + _at;
+		bool has_fraction_or_exponent;
+		if (!OkJsonNumber::skip(p, _text + _size, has_fraction_or_exponent))
+			return fail("expecting value");
+
+		_at = (int32_t)(p - _text);
+		return true;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////
+
+	void write_string(std::pmr::vector<char>& dst, const char* text, size_t size)
+	{
+		static const char k_hex[] = "0123456789abcdef";
+
+		dst.push_back('"');
+
+		// copy runs that need no escape in one go
+		size_t run = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			unsigned char c = (unsigned char)text[i];
+			if (c >= 0x20 && c != '"' && c != '\\')
+				continue;
+
+			dst.insert(dst.end(), text + run, text + i);
+			run = i + 1;
+
+			dst.push_back('\\');
+			switch (c)
+			{
+			case '"': dst.push_back('"'); break;
+			case '\\': dst.push_back('\\'); break;
+			case '\b': dst.push_back('b'); break;
+			case '\f': dst.push_back('f'); break;
+			case '\n': dst.push_back('n'); break;
+			case '\r': dst.push_back('r'); break;
+			case '\t': dst.push_back('t'); break;
+			default:
+				{
+					const char u[] = { 'u', '0', '0', k_hex[c >> 4], k_hex[c & 15] };
+					dst.insert(dst.end(), u, u + 5);
+				}
+				break;
+			}
+		}
+
+		dst.insert(dst.end(), text + run, text + size);
+		dst.push_back('"');
+	}
+
+	void write_uint64(std::pmr::vector<char>& dst, uint64_t v)
+	{
+		char buffer[20];
+		char* p = buffer + sizeof(buffer);
+		do
+		{
+			*--p = (char)('0' + v % 10);
+			v /= 10;
+		} while (v != 0);
+
+		dst.insert(dst.end(), p, buffer + sizeof(buffer));
+	}
+
+	void write_int64(std::pmr::vector<char>& dst, int64_t v)
+	{
+		if (v >= 0)
+		{
+			write_uint64(dst, (uint64_t)v);
+			return;
+		}
+
+		dst.push_back('-');
+		write_uint64(dst, 0 - (uint64_t)v);
+	}
+
+	void write_double(std::pmr::vector<char>& dst, double v)
+	{
+		// json has no inf or nan
+		if (!std::isfinite(v))
+		{
+			dst.insert(dst.end(), "null", "null" + 4);
+			return;
+		}
+
+		// whole numbers are common and need no printf
+		if (std::fabs(v) < 9007199254740992.0 && v == (double)(int64_t)v && (v != 0 || !std::signbit(v)))
+		{
+			write_int64(dst, (int64_t)v);
+			return;
+		}
+
+		// 15 digits are enough for most values, 17 always read back the same
+		char buffer[32];
+		int size = snprintf(buffer, sizeof(buffer), "%.15g", v);
+		if (strtod(buffer, nullptr) != v)
+			size = snprintf(buffer, sizeof(buffer), "%.17g", v);
+
+		dst.insert(dst.end(), buffer, buffer + size);
+	}
+
+	void write_float(std::pmr::vector<char>& dst, float v)
+	{
+		if (!std::isfinite(v))
+		{
+			dst.insert(dst.end(), "null", "null" + 4);
+			return;
+		}
+
+		// same as above with 7 and 9 digits
+		char buffer[32];
+		int size = snprintf(buffer, sizeof(buffer), "%.7g", v);
+		if ((float)strtod(buffer, nullptr) != v)
+			size = snprintf(buffer, sizeof(buffer), "%.9g", v);
+
+		dst.insert(dst.end(), buffer, buffer + size);
+	}
+}
@@ -0,0 +1,321 @@
+#ifndef OK_JSON_BIND_H
+#define OK_JSON_BIND_H
+
+#include "ok_json_reader.h"
+#include "ok_json_writer.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// binds c++ structs to json, the fields are listed once (at global scope):
+//
+//	struct Point { double x; double y; std::string name; };
+//
+//	OK_JSON_BIND_BEGIN(Point)
+//		OK_JSON_FIELD(x)
+//		OK_JSON_FIELD(y)
+//		OK_JSON_FIELD(name)
+//	OK_JSON_BIND_END()
+//
+//	OkJsonBind::decode(text, size, point, &error); // straight from the text, no tree is built
+//	OkJsonBind::encode(writer, point); // appends the json to writer._dest
+//
+// members can be bool, int, int64_t, uint64_t, double, float, std::string, std::vector and other bound structs
+// (more types by specializing OkJsonBind::Codec), keys match by hash and length (like HashedKeyStripped),
+// unknown keys are checked and skipped, members without a key in the json are left as they were
+namespace OkJsonBind
+{
+	// reads json token by token, for Codec specializations
+	struct Decoder
+	{
+		Decoder(const char* text, int size);
+
+		bool read(bool& v);
+		bool read(int64_t& v);
+		bool read(uint64_t& v);
+		bool read(double& v);
+		bool read(std::string& v);
+
+		// for (int i = 0; d.next_key(i, h, size); ++i) { read the value }
+		bool begin_object();
+		bool next_key(int i, uint64_t& h, int32_t& size); // false at the end of the object (or on error)
+
+		// for (int i = 0; d.next_element(i); ++i) { read the value }
+		bool begin_array();
+		bool next_element(int i); // false at the end of the array (or on error)
+
+		bool skip_value(); // checked, not stored
+		bool at_end(); // only whitespace left
+
+		bool fail(const char* desc); // keeps the first error, returns false
+		bool failed() const { return !_error.empty(); }
+		const std::string& get_error() const { return _error; }
+
+	private:
+		void skip_ws();
+		bool read_raw_string(OkJsonReader::TextSpan& v, bool& escaped);
+		bool read_literal(const char* word, int32_t size);
+		bool skip_scalar();
+
+		const char* _text;
+		int32_t _size;
+		int32_t _at = 0;
+		std::string _error;
+
+		std::vector<char> _open; // containers being skipped
+		int32_t _max_depth = 1024; // like ParseOptions::_max_depth
+	};
+
+	// appends json text (to the buffer type of Writer::_dest)
+	void write_string(std::pmr::vector<char>& dst, const char* text, size_t size); // escapes
+	void write_int64(std::pmr::vector<char>& dst, int64_t v);
+	void write_uint64(std::pmr::vector<char>& dst, uint64_t v);
+	void write_double(std::pmr::vector<char>& dst, double v); // reads back the same, null for inf and nan
+	void write_float(std::pmr::vector<char>& dst, float v);
+
+	// filled in by OK_JSON_BIND_BEGIN
+	template<typename T>
+	struct Fields;
+
+	template<typename T>
+	struct Codec;
+
+	// visitors for Fields<T>::visit, a visitor returns false to stop
+	template<typename T>
+	struct DecodeField
+	{
+		Decoder& _d;
+		T& _v;
+		uint64_t _h;
+		int32_t _s;
+		bool _found;
+
+		template<typename M>
+		bool field(M T::* member, const char*, uint64_t h, int32_t size)
+		{
+			if (h != _h || size != _s)
+				return true;
+
+			_found = true;
+			Codec<M>::decode(_d, _v.*member);
+			return false;
+		}
+	};
+
+	template<typename T>
+	struct EncodeField
+	{
+		std::pmr::vector<char>& _dst;
+		const T& _v;
+		bool _first;
+
+		template<typename M>
+		bool field(M T::* member, const char* key, uint64_t, int32_t size)
+		{
+			if (!_first)
+				_dst.push_back(',');
+			_first = false;
+
+			// "key": is written as it is
+			_dst.insert(_dst.end(), key, key + size + 3);
+			Codec<M>::encode(_dst, _v.*member);
+			return true;
+		}
+	};
+
+	// bound structs
+	template<typename T>
+	struct Codec
+	{
+		static bool decode(Decoder& d, T& v)
+		{
+			if (!d.begin_object())
+				return false;
+
+			uint64_t h;
+			int32_t size;
+			for (int i = 0; d.next_key(i, h, size); ++i)
+			{
+				DecodeField<T> f { d, v, h, size, false };
+				Fields<T>::visit(f);
+
+				if (!f._found)
+					d.skip_value();
+
+				if (d.failed())
+					return false;
+			}
+
+			return !d.failed();
+		}
+
+		static void encode(std::pmr::vector<char>& dst, const T& v)
+		{
+			dst.push_back('{');
+			EncodeField<T> f { dst, v, true };
+			Fields<T>::visit(f);
+			dst.push_back('}');
+		}
+	};
+
+	template<>
+	struct Codec<bool>
+	{
+		static bool decode(Decoder& d, bool& v) { return d.read(v); }
+		static void encode(std::pmr::vector<char>& dst, bool v)
+		{
+			const char* text = v ? "true" : "false";
+			dst.insert(dst.end(), text, text + (v ? 4 : 5));
+		}
+	};
+
+	template<>
+	struct Codec<int64_t>
+	{
+		static bool decode(Decoder& d, int64_t& v) { return d.read(v); }
+		static void encode(std::pmr::vector<char>& dst, int64_t v) { write_int64(dst, v); }
+	};
+
+	template<>
+	struct Codec<uint64_t>
+	{
+		static bool decode(Decoder& d, uint64_t& v) { return d.read(v); }
+		static void encode(std::pmr::vector<char>& dst, uint64_t v) { write_uint64(dst, v); }
+	};
+
+	template<>
+	struct Codec<int>
+	{
+		static bool decode(Decoder& d, int& v)
+		{
+			int64_t i;
+			if (!d.read(i))
+				return false;
+
+			if (i < INT32_MIN || i > INT32_MAX)
+				return d.fail("number does not fit in an int");
+
+			v = (int)i;
+			return true;
+		}
+
+		static void encode(std::pmr::vector<char>& dst, int v) { write_int64(dst, v); }
+	};
+
+	template<>
+	struct Codec<double>
+	{
+		static bool decode(Decoder& d, double& v) { return d.read(v); }
+		static void encode(std::pmr::vector<char>& dst, double v) { write_double(dst, v); }
+	};
+
+	template<>
+	struct Codec<float>
+	{
+		static bool decode(Decoder& d, float& v)
+		{
+			double n;
+			if (!d.read(n))
+				return false;
+
+			v = (float)n;
+			return true;
+		}
+
+		static void encode(std::pmr::vector<char>& dst, float v) { write_float(dst, v); }
+	};
+
+	template<>
+	struct Codec<std::string>
+	{
+		static bool decode(Decoder& d, std::string& v) { return d.read(v); }
+		static void encode(std::pmr::vector<char>& dst, const std::string& v) { write_string(dst, v.data(), v.size()); }
+	};
+
+	template<typename E>
+	struct Codec<std::vector<E>>
+	{
+		static bool decode(Decoder& d, std::vector<E>& v)
+		{
+			if (!d.begin_array())
+				return false;
+
+			v.clear();
+			for (int i = 0; d.next_element(i); ++i)
+			{
+				v.emplace_back();
+				if (!Codec<E>::decode(d, v.back()))
+					return false;
+			}
+
+			return !d.failed();
+		}
+
+		static void encode(std::pmr::vector<char>& dst, const std::vector<E>& v)
+		{
+			dst.push_back('[');
+			for (size_t i = 0; i < v.size(); ++i)
+			{
+				if (i != 0)
+					dst.push_back(',');
+				Codec<E>::encode(dst, v[i]);
+			}
+			dst.push_back(']');
+		}
+	};
+
+	// the whole text is one value
+	template<typename T>
+	bool decode(const char* text, int size, T& value, std::string* put_error_here = nullptr)
+	{
+		Decoder d(text, size);
+		if (Codec<T>::decode(d, value) && !d.at_end())
+			d.fail("expecting EOF");
+
+		if (!d.failed())
+			return true;
+
+		if (put_error_here != nullptr)
+			*put_error_here = d.get_error();
+		else
+			puts(d.get_error().c_str());
+
+		return false;
+	}
+
+	template<typename T>
+	void encode(OkJsonWriter::Writer& writer, const T& value)
+	{
+		Codec<T>::encode(writer._dest, value);
+	}
+}
+
+#define OK_JSON_BIND_BEGIN(T) \
+	namespace OkJsonBind \
+	{ \
+		template<> \
+		struct Fields<T> \
+		{ \
+			typedef T Type; \
+			template<typename Visitor> \
+			static void visit(Visitor& v) \
+			{ \
+				(void)(true
+
+// the key is written with its quotes and colon, and hashed by the compiler
+#define OK_JSON_FIELD(name) \
+				&& v.field(&Type::name, "\"" #name "\":", \
+					std::integral_constant<uint64_t, OkJsonReader::key_hash(#name, (int32_t)sizeof(#name) - 1)>::value, \
+					(int32_t)sizeof(#name) - 1)
+
+#define OK_JSON_BIND_END() \
+				); \
+			} \
+		}; \
+	}
+
+#endif // OK_JSON_BIND_H
@@ -0,0 +1,400 @@
+#include "ok_json_cursor.h"
+#include "ok_json_internal.h"
+#include "ok_json_number.h"
+#include "ok_json_scan.h"
+
+#include <cstring>
+
+namespace OkJsonReader
+{
+	using namespace OkJsonReader_Private;
+
+	// for cursors that are not valid
+	static const Parsed k_no_document;
+
+	////////////////////////////////////////////////////////////////
+	// OnDemandReader
+
+	Cursor OnDemandReader::get_root(const char* text, int text_length)
+	{
+		if (text_length < 0)
+			text_length = (int)strlen(text);
+
+		_parsed._text = TextSpan(text, text + text_length);
+		_parsed._lazy_numbers = true;
+		_error.clear();
+
+		Cursor root;
+		root._reader = this;
+
+		int32_t p = skip_ws(0);
+		if (p < 0)
+			return root;
+
+		if (p == text_length)
+		{
+			set_error(p, "expecting value");
+			return root;
+		}
+
+		root._b = p;
+		return root;
+	}
+
+	int32_t OnDemandReader::set_error(int32_t p, const char* desc) const
+	{
+		// keep the first one
+		if (_error.empty())
+		{
+			TextSpan read(_parsed._text._b + p, _parsed._text._e);
+			line_and_col_to_string(_parsed._text, read, _error, desc);
+		}
+
+		return -1;
+	}
+
+	// also skips comments, returns -1 on error
+	int32_t OnDemandReader::skip_ws(int32_t p) const
+	{
+		const char* text = _parsed._text._b;
+		int32_t size = (int32_t)(_parsed._text._e - text);
+		for (;;)
+		{
+			while (p < size && is_ws(text[p]))
+				++p;
+
+			if (p >= size || text[p] != '/')
+				return p;
+
+			if (p + 1 >= size || text[p + 1] != '/')
+				return set_error(p + 1, "comment starts with //");
+
+			while (p < size && text[p] != '\n')
+				++p;
+		}
+	}
+
+	int32_t OnDemandReader::string_end(int32_t p) const
+	{
+		const char* text = _parsed._text._b;
+		int32_t size = (int32_t)(_parsed._text._e - text);
+		for (;;)
+		{
+			const char* quote = (const char*)memchr(text + p, '"', (size_t)(size - p));
+			if (quote == nullptr)
+				return set_error(size, "string needs to end with \"");
+
+			// escaped if after an odd number of backslashes
+			int32_t at = (int32_t)(quote - text);
+			int32_t backslashes = 0;
+			while (at - backslashes > p && text[at - backslashes - 1] == '\\')
+				++backslashes;
+
+			if ((backslashes & 1) == 0)
+				return at;
+
+			p = at + 1;
+		}
+	}
+
+	int32_t OnDemandReader::value_end(int32_t p) const
+	{
+		const char* text = _parsed._text._b;
+		int32_t size = (int32_t)(_parsed._text._e - text);
+		if (p >= size)
+			return set_error(p, "expecting value");
+
+		switch (text[p])
+		{
+		case '{':
+		case '[':
+		{
+			const char* e = OkJsonScan::skip_container(text + p, text + size);
+			if (e == nullptr)
+				return set_error(size, text[p] == '{' ? "object needs to end with }" : "array needs to end with ]");
+			return (int32_t)(e - text);
+		}
+
+		case '"':
+		{
+			int32_t e = string_end(p + 1);
+			return e < 0 ? e : e + 1;
+		}
+
+		case 't':
+			if (size - p >= 4 && memcmp(text + p, "true", 4) == 0)
+				return p + 4;
+			return set_error(p + 1, "invalid value, expecting \"true\"");
+
+		case 'f':
+			if (size - p >= 5 && memcmp(text + p, "false", 5) == 0)
+				return p + 5;
+			return set_error(p + 1, "invalid value, expecting \"false\"");
+
+		case 'n':
+			if (size - p >= 4 && memcmp(text + p, "null", 4) == 0)
+				return p + 4;
+			return set_error(p + 1, "invalid value, expecting \"null\"");
+		}
+
+		const char* b = text + p;
+		bool has_fraction_or_exponent;
+		if (!OkJsonNumber::skip(b, text + size, has_fraction_or_exponent))
+			return set_error((int32_t)(b - text), "invalid number");
+
+		return (int32_t)(b - text);
+	}
+
+	Cursor OnDemandReader::member_at(int32_t p, bool in_object) const
+	{
+		const char* text = _parsed._text._b;
+		int32_t size = (int32_t)(_parsed._text._e - text);
+
+		Cursor c;
+		c._reader = this;
+
+		p = skip_ws(p);
+		if (p < 0)
+			return c;
+
+		if (p >= size)
+		{
+			set_error(p, in_object ? "object needs to end with }" : "array needs to end with ]");
+			return c;
+		}
+
+		// end of the container
+		if (text[p] == (in_object ? '}' : ']'))
+			return c;
+
+		if (in_object)
+		{
+			if (text[p] != '"')
+			{
+				set_error(p, "key needs to start with \"");
+				return c;
+			}
+
+			int32_t key_b = p + 1;
+			int32_t key_e = string_end(key_b);
+			if (key_e < 0)
+				return c;
+
+			p = skip_ws(key_e + 1);
+			if (p < 0)
+				return c;
+
+			if (p >= size || text[p] != ':')
+			{
+				set_error(p, "need \":\" after key");
+				return c;
+			}
+
+			p = skip_ws(p + 1);
+			if (p < 0)
+				return c;
+
+			c._key_b = key_b;
+			c._key_e = key_e;
+		}
+
+		c._b = p;
+		return c;
+	}
+
+	////////////////////////////////////////////////////////////////
+	// Cursor
+
+	bool Cursor::is_valid() const
+	{
+		return _b >= 0;
+	}
+
+	Type Cursor::get_type() const
+	{
+		if (!is_valid())
+			return e_null;
+
+		const char* text = _reader->_parsed._text._b;
+		switch (text[_b])
+		{
+		case '{': return e_object;
+		case '[': return e_array;
+		case '"': return e_string;
+		case 't': return e_true;
+		case 'f': return e_false;
+		case 'n': return e_null;
+		}
+
+		const char* b = text + _b;
+		bool has_fraction_or_exponent;
+		if (!OkJsonNumber::skip(b, _reader->_parsed._text._e, has_fraction_or_exponent))
+			return e_null;
+
+		return has_fraction_or_exponent ? e_number : e_int;
+	}
+
+	TextSpan Cursor::get_raw() const
+	{
+		if (!is_valid())
+			return TextSpan();
+
+		int32_t e = _reader->value_end(_b);
+		if (e < 0)
+			return TextSpan();
+
+		const char* text = _reader->_parsed._text._b;
+		return TextSpan(text + _b, text + e);
+	}
+
+	TextSpan Cursor::get_key() const
+	{
+		if (_key_b < 0)
+			return TextSpan();
+
+		const char* text = _reader->_parsed._text._b;
+		return TextSpan(text + _key_b, text + _key_e);
+	}
+
+	Proxy Cursor::get_proxy() const
+	{
+		if (!is_valid())
+			return Proxy({ e_null, -1, -1, 0 }, _reader != nullptr ? &_reader->_parsed : &k_no_document);
+
+		Value v { get_type(), _b, -1, 0 };
+		switch (v._t)
+		{
+		case e_object:
+		case e_array:
+			// no nodes, the getters fail the same way as for a parsed container
+			v._b = 0;
+			v._e = 0;
+			break;
+
+		case e_string:
+			v._b = _b + 1;
+			v._e = _reader->string_end(v._b);
+			if (v._e < 0)
+				v = { e_null, -1, -1, 0 };
+			break;
+
+		default:
+			v._e = _reader->value_end(_b);
+			if (v._e < 0)
+				v = { e_null, -1, -1, 0 };
+			break;
+		}
+
+		return Proxy(v, &_reader->_parsed);
+	}
+
+	int Cursor::size() const
+	{
+		Type t = get_type();
+		if (t == e_string)
+			return get_proxy().size();
+
+		if (t != e_object && t != e_array)
+			return 0;
+
+		int count = 0;
+		for (Cursor c = get_first_child(); c.is_valid(); c = c.get_next_sibling())
+			++count;
+
+		return count;
+	}
+
+	Cursor Cursor::get_first_child() const
+	{
+		Type t = get_type();
+		if (t != e_object && t != e_array)
+		{
+			Cursor c;
+			c._reader = _reader;
+			return c;
+		}
+
+		return _reader->member_at(_b + 1, t == e_object);
+	}
+
+	Cursor Cursor::get_next_sibling() const
+	{
+		Cursor c;
+		c._reader = _reader;
+		if (!is_valid())
+			return c;
+
+		bool in_object = _key_b >= 0;
+
+		int32_t p = _reader->value_end(_b);
+		if (p < 0)
+			return c;
+
+		p = _reader->skip_ws(p);
+		if (p < 0)
+			return c;
+
+		const char* text = _reader->_parsed._text._b;
+		int32_t size = (int32_t)(_reader->_parsed._text._e - text);
+		if (p < size && text[p] == ',')
+			return _reader->member_at(p + 1, in_object);
+
+		if (p < size && text[p] == (in_object ? '}' : ']'))
+			return c;
+
+		_reader->set_error(p, in_object ? "need \",\" between key-values" : "need \",\" between values");
+		return c;
+	}
+
+	Cursor Cursor::get_child(int index) const
+	{
+		Cursor c = get_first_child();
+		for (int i = 0; i < index && c.is_valid(); ++i)
+			c = c.get_next_sibling();
+
+		return c;
+	}
+
+	Cursor Cursor::get_child(HashedKey key) const
+	{
+		if (get_type() != e_object)
+		{
+			Cursor c;
+			c._reader = _reader;
+			return c;
+		}
+
+		const char* text = _reader->_parsed._text._b;
+		Cursor c = get_first_child();
+		for (; c.is_valid(); c = c.get_next_sibling())
+		{
+			int32_t size = c._key_e - c._key_b;
+			if (size == key._s && memcmp(text + c._key_b, key._b, (size_t)size) == 0)
+				break;
+		}
+
+		return c;
+	}
+
+	Cursor Cursor::get_child(HashedKeyStripped key) const
+	{
+		if (get_type() != e_object)
+		{
+			Cursor c;
+			c._reader = _reader;
+			return c;
+		}
+
+		// same match as Proxy (hash and length)
+		const char* text = _reader->_parsed._text._b;
+		Cursor c = get_first_child();
+		for (; c.is_valid(); c = c.get_next_sibling())
+		{
+			int32_t size = c._key_e - c._key_b;
+			if (size == key._s && key_hash(text + c._key_b, size) == key._h)
+				break;
+		}
+
+		return c;
+	}
+};
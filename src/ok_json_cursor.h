@@ -0,0 +1,72 @@
+#ifndef OK_JSON_CURSOR_H
+#define OK_JSON_CURSOR_H
+
+#include "ok_json_reader.h"
+
+#include <cstdint>
+#include <string>
+
+namespace OkJsonReader
+{
+	struct OnDemandReader;
+
+	// a value in the text of an on-demand document, nothing is parsed until it is asked for
+	// children are found by scanning the container from its start, values that are passed over
+	// are skipped by counting brackets (they are not validated and nothing is stored for them)
+	struct Cursor
+	{
+		bool is_valid() const; // false if missing, or if the text was invalid (see OnDemandReader::get_error)
+		Type get_type() const; // e_null if not valid
+		TextSpan get_raw() const; // all the text of the value (containers too)
+		TextSpan get_key() const; // raw key if this came from an object
+
+		// same getters as Proxy, for strings, numbers and literals
+		template<typename T>
+		bool try_get(T& v) const { return get_proxy().try_get(v); }
+
+		int size() const; // children of a container (scans all of it), length of a string
+
+		Cursor get_child(int index) const;
+		Cursor get_child(HashedKey key) const;
+		Cursor get_child(HashedKeyStripped key) const;
+
+		// to walk all children without scanning from the start every time
+		Cursor get_first_child() const;
+		Cursor get_next_sibling() const;
+
+	private:
+		friend struct OnDemandReader;
+
+		Proxy get_proxy() const;
+
+		const OnDemandReader* _reader = nullptr;
+		int32_t _b = -1; // start of the value in the text
+		int32_t _key_b = -1; // raw key (inside the quotes), -1 if not in an object
+		int32_t _key_e = -1;
+	};
+
+	// for when only a few values of a large document are needed
+	// the document is only checked where it is read, a full parse (Reader) finds all errors
+	struct OnDemandReader
+	{
+		// warning, the cursors point to the submitted text (and to this reader)
+		Cursor get_root(const char* text, int text_length = -1);
+
+		// the first error found while navigating, empty if none
+		const std::string& get_error() const { return _error; }
+
+	private:
+		friend struct Cursor;
+
+		int32_t skip_ws(int32_t p) const;
+		int32_t string_end(int32_t p) const; // p after the opening quote, returns the closing quote
+		int32_t value_end(int32_t p) const;
+		Cursor member_at(int32_t p, bool in_object) const; // p at a key (or value in an array), or the closing bracket
+		int32_t set_error(int32_t p, const char* desc) const;
+
+		Parsed _parsed; // only the text, numbers are lazy
+		mutable std::string _error;
+	};
+};
+
+#endif // OK_JSON_CURSOR_H
@@ -0,0 +1,416 @@
+#include "ok_json_edit.h"
+#include "ok_json_internal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace OkJsonEdit_Private
+{
+	using namespace OkJsonReader;
+
+	bool edit_error(std::string* put_error_here, const std::string& desc)
+	{
+		if (put_error_here != nullptr)
+			*put_error_here = desc;
+		else
+			puts(desc.c_str());
+
+		return false;
+	}
+
+	// offsets of the value in the text
+	Key source_of(const Proxy& p, const char* text)
+	{
+		TextSpan source = p.get_source();
+		if (source._b == nullptr)
+			return { -1, -1 };
+
+		return { (int32_t)(source._b - text), (int32_t)(source._e - text) };
+	}
+}
+
+namespace OkJsonReader
+{
+	using namespace OkJsonEdit_Private;
+	using namespace OkJsonReader_Private;
+
+	Editor::Editor(const Proxy& root)
+		: _parsed(root._parsed)
+		, _text(root._parsed->_text)
+	{
+	}
+
+	bool Editor::set(const Proxy& value, const char* json, std::string* put_error_here)
+	{
+		if (!check_node(value, e_null, put_error_here))
+			return false;
+
+		int32_t text = add_json(json, put_error_here);
+		if (text < 0)
+			return false;
+
+		// replaces the value, and with it any edit that was made to it
+		Key source = source_of(value, _text._b);
+		auto found = _edit_of.find(source._b);
+		if (found != _edit_of.end())
+		{
+			Edit& edit = _edits[found->second];
+			edit._json = text;
+			edit._container = -1;
+			return true;
+		}
+
+		_edit_of[source._b] = (int32_t)_edits.size();
+		_edits.push_back({ source._b, source._e, text, -1 });
+		return true;
+	}
+
+	bool Editor::set(const Proxy& object, HashedKey key, const char* json, std::string* put_error_here)
+	{
+		if (!check_node(object, e_object, put_error_here))
+			return false;
+
+		int32_t i = find_key(object, key);
+		if (i >= 0)
+			return set(object.get_child(i), json, put_error_here);
+
+		int32_t text = add_json(json, put_error_here);
+		if (text < 0)
+			return false;
+
+		Container* c = find_container(object, put_error_here);
+		if (c == nullptr)
+			return false;
+
+		std::string quoted = "\"";
+		quoted.append(key._b, (size_t)key._s);
+		quoted += '\"';
+
+		// a key that was added before gets the new value
+		for (Child& child : c->_changes)
+		{
+			if (child._key >= 0 && _json_texts[child._key] == quoted)
+			{
+				child._json = text;
+				return true;
+			}
+		}
+
+		_json_texts.push_back(quoted);
+		c->_changes.push_back({ c->_value._e - c->_value._b, text, (int32_t)_json_texts.size() - 1 });
+		return true;
+	}
+
+	bool Editor::insert(const Proxy& array, int i, const char* json, std::string* put_error_here)
+	{
+		if (!check_node(array, e_array, put_error_here))
+			return false;
+
+		if (i < 0 || i > array.size())
+			return edit_error(put_error_here, "insert at " + std::to_string(i) + " is outside the array");
+
+		int32_t text = add_json(json, put_error_here);
+		if (text < 0)
+			return false;
+
+		Container* c = find_container(array, put_error_here);
+		if (c == nullptr)
+			return false;
+
+		c->_changes.push_back({ i, text, -1 });
+		return true;
+	}
+
+	bool Editor::remove(const Proxy& object, HashedKey key, std::string* put_error_here)
+	{
+		if (!check_node(object, e_object, put_error_here))
+			return false;
+
+		int32_t i = find_key(object, key);
+		if (i >= 0)
+		{
+			Container* c = find_container(object, put_error_here);
+			if (c == nullptr)
+				return false;
+
+			for (const Child& child : c->_changes)
+			{
+				if (child._before == i && child._json < 0)
+					return true; // already removed
+			}
+
+			c->_changes.push_back({ i, -1, -1 });
+			return true;
+		}
+
+		// or a key that was added
+		auto found = _edit_of.find(source_of(object, _text._b)._b);
+		Container* c = found != _edit_of.end() && _edits[found->second]._json < 0 ? &_containers[_edits[found->second]._container] : nullptr;
+		for (size_t k = 0; c != nullptr && k < c->_changes.size(); ++k)
+		{
+			const Child& child = c->_changes[k];
+			if (child._key >= 0 && _json_texts[child._key].compare(1, (size_t)key._s, key._b, (size_t)key._s) == 0
+				&& _json_texts[child._key].size() == (size_t)key._s + 2)
+			{
+				c->_changes.erase(c->_changes.begin() + k);
+				return true;
+			}
+		}
+
+		return edit_error(put_error_here, std::string("key not found, ") + std::string(key._b, (size_t)key._s));
+	}
+
+	bool Editor::remove(const Proxy& array, int i, std::string* put_error_here)
+	{
+		if (!check_node(array, e_array, put_error_here))
+			return false;
+
+		if (i < 0 || i >= array.size())
+			return edit_error(put_error_here, "remove at " + std::to_string(i) + " is outside the array");
+
+		Container* c = find_container(array, put_error_here);
+		if (c == nullptr)
+			return false;
+
+		for (const Child& child : c->_changes)
+		{
+			if (child._before == i && child._json < 0)
+				return true;
+		}
+
+		c->_changes.push_back({ i, -1, -1 });
+		return true;
+	}
+
+	void Editor::write(std::string& dst) const
+	{
+		_order.resize(_edits.size());
+		for (size_t i = 0; i < _order.size(); ++i)
+			_order[i] = i;
+
+		std::sort(_order.begin(), _order.end(), [&](size_t a, size_t b)
+		{
+			return _edits[a]._b < _edits[b]._b;
+		});
+
+		size_t size = (size_t)(_text._e - _text._b);
+		for (const std::string& json : _json_texts)
+			size += json.size() + 1;
+		dst.reserve(dst.size() + size);
+
+		write_range(0, (int32_t)(_text._e - _text._b), 0, dst);
+	}
+
+	void Editor::clear()
+	{
+		_edits.clear();
+		_edit_of.clear();
+		_containers.clear();
+		_json_texts.clear();
+	}
+
+	int32_t Editor::add_json(const char* json, std::string* put_error_here)
+	{
+		std::string error;
+		if (!_check.parse(json, -1, &error))
+		{
+			edit_error(put_error_here, "value is not json, " + error);
+			return -1;
+		}
+
+		// a comment after the value would take out what follows it in the document
+		TextSpan source = _check.get_root().get_source();
+		for (const char* p = source._e; *p != 0; ++p)
+		{
+			if (!is_ws(*p))
+			{
+				edit_error(put_error_here, "value can only have whitespace after it");
+				return -1;
+			}
+		}
+
+		_json_texts.emplace_back(source._b, source._e);
+		return (int32_t)_json_texts.size() - 1;
+	}
+
+	bool Editor::check_node(const Proxy& p, Type t, std::string* put_error_here) const
+	{
+		if (p._parsed != _parsed)
+			return edit_error(put_error_here, "not a value of the document of this editor");
+
+		if (_parsed->_tape_layout || _parsed->_unescaped)
+			return edit_error(put_error_here, "the tape layout and parse_in_situ can not be edited");
+
+		if (t != e_null && p._value._t != t)
+			return edit_error(put_error_here, t == e_object ? "not an object" : "not an array");
+
+		Key source = source_of(p, _text._b);
+		if (source._b < 0)
+			return edit_error(put_error_here, "value is missing");
+
+		for (const Edit& edit : _edits)
+		{
+			if (edit._json >= 0 && source._b > edit._b && source._e <= edit._e)
+				return edit_error(put_error_here, "value is inside a value that was replaced");
+		}
+
+		return true;
+	}
+
+	Editor::Container* Editor::find_container(const Proxy& p, std::string* put_error_here)
+	{
+		Key source = source_of(p, _text._b);
+		auto found = _edit_of.find(source._b);
+		if (found != _edit_of.end())
+		{
+			const Edit& edit = _edits[found->second];
+			if (edit._json >= 0)
+			{
+				edit_error(put_error_here, "value was replaced");
+				return nullptr;
+			}
+
+			return &_containers[edit._container];
+		}
+
+		_edit_of[source._b] = (int32_t)_edits.size();
+		_edits.push_back({ source._b, source._e, -1, (int32_t)_containers.size() });
+		_containers.push_back({ p._value, {} });
+		return &_containers.back();
+	}
+
+	int32_t Editor::find_key(const Proxy& object, const HashedKey& key) const
+	{
+		const KvP* kvps = _parsed->_object_kvps.data() + object._value._b;
+		const uint64_t* hashes = _parsed->_key_hashes.data() + object._value._b;
+		int32_t size = object._value._e - object._value._b;
+		for (int32_t i = 0; i < size; ++i)
+		{
+			const Key& k = kvps[i]._k;
+			if (hashes[i] == key._h && k._e - k._b == key._s && memcmp(_text._b + k._b, key._b, (size_t)key._s) == 0)
+				return i;
+		}
+
+		return -1;
+	}
+
+	// an element, or a kvp from the quote of its key
+	Key Editor::child_source(const Value& container, int32_t i) const
+	{
+		if (container._t == e_array)
+			return source_of(Proxy(_parsed->_array_values[container._b + i], _parsed), _text._b);
+
+		const KvP& kvp = _parsed->_object_kvps[container._b + i];
+		return { kvp._k._b - 1, source_of(Proxy(kvp._v, _parsed), _text._b)._e };
+	}
+
+	// [b, e) of the text with the edits in it, _order[at] is the first edit that can be in it
+	// returns the first edit after it
+	size_t Editor::write_range(int32_t b, int32_t e, size_t at, std::string& dst) const
+	{
+		for (; at < _order.size(); )
+		{
+			const Edit& edit = _edits[_order[at]];
+			if (edit._b >= e)
+				break;
+
+			if (edit._b < b)
+			{
+				++at; // in a child that was removed
+				continue;
+			}
+
+			dst.append(_text._b + b, (size_t)(edit._b - b));
+			at = write_edit(at, dst);
+			b = edit._e;
+		}
+
+		dst.append(_text._b + b, (size_t)(e - b));
+		return at;
+	}
+
+	size_t Editor::write_edit(size_t at, std::string& dst) const
+	{
+		const Edit& edit = _edits[_order[at]];
+		++at;
+
+		if (edit._json >= 0)
+			dst += _json_texts[edit._json];
+		else
+			at = write_container(_containers[edit._container], at, dst);
+
+		// edits inside it are done (or were replaced with it)
+		while (at < _order.size() && _edits[_order[at]]._b < edit._e)
+			++at;
+
+		return at;
+	}
+
+	// the children that are kept are copied in runs, with the text between them
+	size_t Editor::write_container(const Container& c, size_t at, std::string& dst) const
+	{
+		std::vector<Child> changes = c._changes;
+		std::stable_sort(changes.begin(), changes.end(), [](const Child& a, const Child& b)
+		{
+			return a._before < b._before;
+		});
+
+		bool first = true;
+		int32_t run = -1; // first child of the run that is not written yet
+		auto write_run = [&](int32_t end)
+		{
+			if (run < 0)
+				return;
+
+			if (!first)
+				dst += ',';
+			first = false;
+
+			at = write_range(child_source(c._value, run)._b, child_source(c._value, end - 1)._e, at, dst);
+			run = -1;
+		};
+
+		dst += c._value._t == e_object ? '{' : '[';
+
+		int32_t size = c._value._e - c._value._b;
+		size_t k = 0;
+		for (int32_t i = 0; i <= size; ++i)
+		{
+			bool removed = false;
+			for (; k < changes.size() && changes[k]._before == i; ++k)
+			{
+				const Child& child = changes[k];
+				if (child._json < 0)
+				{
+					removed = true;
+					continue;
+				}
+
+				write_run(i);
+				if (!first)
+					dst += ',';
+				first = false;
+
+				if (child._key >= 0)
+				{
+					dst += _json_texts[child._key];
+					dst += ':';
+				}
+				dst += _json_texts[child._json];
+			}
+
+			if (i == size)
+				break;
+
+			if (removed)
+				write_run(i);
+			else if (run < 0)
+				run = i;
+		}
+
+		write_run(size);
+		dst += c._value._t == e_object ? '}' : ']';
+		return at;
+	}
+};
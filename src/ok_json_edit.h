@@ -0,0 +1,87 @@
+#ifndef OK_JSON_EDIT_H
+#define OK_JSON_EDIT_H
+
+#include "ok_json_reader.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+namespace OkJsonReader
+{
+	// changes to a parsed document that is written back as text
+	// the text that was not changed is copied as it is (formatting and comments included), only the
+	// containers that got or lost children are put together again (from the text of their children)
+	// so writing a document with a few changes costs about as much as copying it
+	// values are json text (checked to be one value), keys are as in the json (with escape codes)
+	// the proxies are of the tree the editor was made with, in its default layout (not the tape or parse_in_situ)
+	// and are the nodes as they were parsed (indices do not move when something is inserted or removed)
+	struct Editor
+	{
+		explicit Editor(const Proxy& root);
+
+		// replace any value (a container with all that is in it)
+		bool set(const Proxy& value, const char* json, std::string* put_error_here = nullptr);
+
+		// replace the value of key, or add the key at the end of the object
+		bool set(const Proxy& object, HashedKey key, const char* json, std::string* put_error_here = nullptr);
+
+		// before element i, size() adds to the end
+		bool insert(const Proxy& array, int i, const char* json, std::string* put_error_here = nullptr);
+
+		bool remove(const Proxy& object, HashedKey key, std::string* put_error_here = nullptr);
+		bool remove(const Proxy& array, int i, std::string* put_error_here = nullptr);
+
+		// appends the changed document
+		void write(std::string& dst) const;
+
+		// forget all changes
+		void clear();
+
+	private:
+		// a replaced value, or a container with changed children
+		struct Edit
+		{
+			int32_t _b; // what it replaces in the text
+			int32_t _e;
+			int32_t _json; // into _json_texts (set), -1 for a container
+			int32_t _container; // into _containers
+		};
+
+		struct Child
+		{
+			int32_t _before; // child this goes before, size for the end (inserts)
+			int32_t _json; // into _json_texts, -1 for a removed child (the one in _before)
+			int32_t _key; // into _json_texts, -1 for arrays
+		};
+
+		struct Container
+		{
+			Value _value;
+			std::vector<Child> _changes; // in the order they were made
+		};
+
+		int32_t add_json(const char* json, std::string* put_error_here); // -1 if it is not one value
+		bool check_node(const Proxy& p, Type t, std::string* put_error_here) const; // e_null for any type
+		Container* find_container(const Proxy& p, std::string* put_error_here);
+		int32_t find_key(const Proxy& object, const HashedKey& key) const;
+		Key child_source(const Value& container, int32_t i) const;
+		size_t write_range(int32_t b, int32_t e, size_t at, std::string& dst) const;
+		size_t write_edit(size_t at, std::string& dst) const;
+		size_t write_container(const Container& c, size_t at, std::string& dst) const;
+
+		const Parsed* _parsed;
+		TextSpan _text;
+
+		std::vector<Edit> _edits;
+		std::unordered_map<int32_t, int32_t> _edit_of; // by _b, a value has one edit (set replaces all others)
+		std::vector<Container> _containers;
+		std::vector<std::string> _json_texts;
+		mutable std::vector<size_t> _order; // edits sorted by place, when writing
+
+		Reader _check; // parses the json of values
+	};
+};
+
+#endif // OK_JSON_EDIT_H
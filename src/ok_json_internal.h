@@ -0,0 +1,18 @@
+#ifndef OK_JSON_INTERNAL_H
+#define OK_JSON_INTERNAL_H
+
+#include "ok_json_reader.h"
+
+#include <string>
+
+// internal, helpers of ok_json_reader.cpp that the other parts of the library use
+namespace OkJsonReader_Private
+{
+	// "line: 3, col: 7 desc: " + desc, the position of read in full_text
+	void line_and_col_to_string(OkJsonReader::TextSpan full_text, OkJsonReader::TextSpan read, std::string& dst, const char* desc);
+
+	// the whitespace the parser skips
+	bool is_ws(char c);
+}
+
+#endif // OK_JSON_INTERNAL_H
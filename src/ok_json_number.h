@@ -0,0 +1,37 @@
+#ifndef OK_JSON_NUMBER_H
+#define OK_JSON_NUMBER_H
+
+#include <cstdint>
+
+// internal, exact number conversion used by the reader
+namespace OkJsonNumber
+{
+	// a number split into parts while scanning the text
+	// value = (-1 if _negative) * _mantissa * 10^_exponent
+	struct Decimal
+	{
+		uint64_t _mantissa = 0; // as many leading digits as fit
+		int64_t _exponent = 0;
+		bool _negative = false;
+		bool _truncated = false; // non-zero digits that did not fit were dropped
+	};
+
+	// scan a json number starting at p, p is moved past the number
+	// returns false (with p at the offending character) if the number is malformed
+	bool scan(const char*& p, const char* e, Decimal& d);
+
+	// same as scan but only checks the syntax, has_fraction_or_exponent is set if there is a '.', 'e' or 'E'
+	bool skip(const char*& p, const char* e, bool& has_fraction_or_exponent);
+
+	// correctly rounded (round to nearest even), [b, e) is the text the decimal was scanned from
+	double to_double(const Decimal& d, const char* b, const char* e);
+
+	// "-0", "-0.0", "-0e5", only a double has its sign
+	bool is_negative_zero(const Decimal& d);
+
+	// true if the number is an integer that fits
+	bool to_int64(const Decimal& d, int64_t& v);
+	bool to_uint64(const Decimal& d, uint64_t& v);
+}
+
+#endif // OK_JSON_NUMBER_H
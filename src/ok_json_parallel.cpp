@@ -0,0 +1,536 @@
+#include "ok_json_parallel.h"
+#include "ok_json_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace OkJsonParallel_Private
+{
+	int resolve_thread_count(int count)
+	{
+		if (count > 0)
+			return count;
+
+		int cores = (int)std::thread::hardware_concurrency();
+		return cores > 0 ? cores : 1;
+	}
+
+	bool is_ws(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+	}
+
+	// indices of containers move when the slices are joined
+	OkJsonReader::Value rebase(OkJsonReader::Value v, int32_t array_base, int32_t object_base)
+	{
+		if (v._t == OkJsonReader::e_array)
+		{
+			v._b += array_base;
+			v._e += array_base;
+		}
+		else if (v._t == OkJsonReader::e_object)
+		{
+			v._b += object_base;
+			v._e += object_base;
+		}
+
+		return v;
+	}
+}
+
+namespace OkJsonReader
+{
+	using namespace OkJsonParallel_Private;
+
+	// the calling thread helps, so a pool of n threads starts n - 1 workers
+	struct ThreadPool
+	{
+		ThreadPool(int thread_count)
+		{
+			for (int i = 1; i < thread_count; ++i)
+				_workers.emplace_back([this] { worker(); });
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stop = true;
+			}
+			_wake.notify_all();
+
+			for (std::thread& t : _workers)
+				t.join();
+		}
+
+		int get_thread_count() const
+		{
+			return (int)_workers.size() + 1;
+		}
+
+		// calls task(i) for i in [0, task_count), returns when all are done
+		void run(int task_count, const std::function<void(int)>& task)
+		{
+			if (task_count <= 0)
+				return;
+
+			{
+				// workers still in work() from the last run would take tasks from the new counters
+				std::unique_lock<std::mutex> lock(_mutex);
+				_finished.wait(lock, [&] { return _active == 0; });
+
+				_task = &task;
+				_task_count = task_count;
+				_done = 0;
+				_next = 0;
+				++_generation;
+			}
+			_wake.notify_all();
+
+			work();
+
+			std::unique_lock<std::mutex> lock(_mutex);
+			_finished.wait(lock, [&] { return _done == _task_count && _active == 0; });
+			_task = nullptr;
+		}
+
+	private:
+		void work()
+		{
+			for (;;)
+			{
+				int i = _next.fetch_add(1);
+				if (i >= _task_count)
+					return;
+
+				(*_task)(i);
+
+				if (_done.fetch_add(1) + 1 == _task_count)
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_finished.notify_all();
+				}
+			}
+		}
+
+		void worker()
+		{
+			uint64_t seen = 0;
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_mutex);
+					_wake.wait(lock, [&] { return _stop || _generation != seen; });
+					if (_stop)
+						return;
+
+					seen = _generation;
+					++_active;
+				}
+
+				work();
+
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					if (--_active == 0)
+						_finished.notify_all();
+				}
+			}
+		}
+
+		std::vector<std::thread> _workers;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _finished;
+		bool _stop = false;
+		uint64_t _generation = 0;
+		int _active = 0; // workers in work(), run() waits for them before and after
+
+		const std::function<void(int)>* _task = nullptr;
+		std::atomic<int> _task_count { 0 };
+		std::atomic<int> _next { 0 };
+		std::atomic<int> _done { 0 };
+	};
+
+	////////////////////////////////////////////////////////////////
+	// LinesReader
+
+	LinesReader::LinesReader()
+	{
+	}
+
+	LinesReader::~LinesReader()
+	{
+	}
+
+	void LinesReader::set_options(const ParseOptions& options)
+	{
+		_options = options;
+	}
+
+	void LinesReader::set_thread_count(int count)
+	{
+		if (count != _thread_count)
+			_pool.reset();
+
+		_thread_count = count;
+	}
+
+	ThreadPool* LinesReader::get_pool()
+	{
+		if (!_pool)
+			_pool.reset(new ThreadPool(resolve_thread_count(_thread_count)));
+
+		return _pool.get();
+	}
+
+	bool LinesReader::parse(const char* text, int text_length, std::string* put_error_here)
+	{
+		if (text_length < 0)
+		{
+			text_length = 0;
+			while (text[text_length] != 0)
+				++text_length;
+		}
+
+		_text = TextSpan(text, text + text_length);
+		_lines.clear();
+
+		// split, skip lines that are only whitespace
+		OkJsonScan::find_newlines(text, text + text_length, _newlines);
+		_newlines.push_back((uint32_t)text_length);
+
+		int32_t line_begin = 0;
+		for (uint32_t newline : _newlines)
+		{
+			int32_t b = line_begin;
+			int32_t e = (int32_t)newline;
+			line_begin = e + 1;
+
+			while (b < e && is_ws(text[b]))
+				++b;
+			while (e > b && is_ws(text[e - 1]))
+				--e;
+
+			if (b < e)
+				_lines.push_back({ b, e, 0, -1, { e_null, -1, -1, 0 } });
+		}
+
+		// one task per thread, split by bytes
+		ThreadPool* pool = get_pool();
+		int task_count = pool->get_thread_count();
+		if (task_count > (int)_lines.size())
+			task_count = (int)_lines.size();
+
+		std::vector<int> task_begin(task_count + 1, (int)_lines.size());
+		int64_t bytes_per_task = task_count > 0 ? (text_length + task_count - 1) / task_count : 0;
+		for (int t = 0, line = 0; t < task_count; ++t)
+		{
+			while (line < (int)_lines.size() && _lines[line]._b < bytes_per_task * t)
+				++line;
+			task_begin[t] = line;
+		}
+
+		if (_arenas.size() < (size_t)task_count)
+			_arenas.resize(task_count);
+
+		pool->run(task_count, [&](int t)
+		{
+			Arena& arena = _arenas[t];
+			arena._parsed._text = _text;
+			arena._parsed._array_values.clear();
+			arena._parsed._object_kvps.clear();
+			arena._parsed._key_hashes.clear();
+			arena._parsed._tape.clear();
+			arena._parsed._object_index_slots.clear();
+			arena._parsed._object_indices.clear();
+			arena._errors.clear();
+
+			std::string error;
+			for (int i = task_begin[t]; i < task_begin[t + 1]; ++i)
+			{
+				Line& line = _lines[i];
+				line._arena = t;
+
+				TextSpan part(text + line._b, text + line._e);
+				if (!parse_part(arena._parsed, arena._scratch, _options, part, line._root, &error))
+				{
+					line._error = (int32_t)arena._errors.size();
+					arena._errors.push_back(error);
+				}
+			}
+		});
+
+		for (const Line& line : _lines)
+		{
+			if (line._error >= 0)
+			{
+				const std::string& error = _arenas[line._arena]._errors[line._error];
+				if (put_error_here != nullptr)
+					*put_error_here = error;
+				else
+					puts(error.c_str());
+
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	int LinesReader::size() const
+	{
+		return (int)_lines.size();
+	}
+
+	bool LinesReader::is_valid(int i) const
+	{
+		return _lines[i]._error < 0;
+	}
+
+	Proxy LinesReader::get_root(int i) const
+	{
+		const Line& line = _lines[i];
+		return Proxy(line._root, &_arenas[line._arena]._parsed);
+	}
+
+	TextSpan LinesReader::get_line(int i) const
+	{
+		const Line& line = _lines[i];
+		return TextSpan(_text._b + line._b, _text._b + line._e);
+	}
+
+	const std::string& LinesReader::get_error(int i) const
+	{
+		static const std::string k_no_error;
+
+		const Line& line = _lines[i];
+		if (line._error < 0)
+			return k_no_error;
+
+		return _arenas[line._arena]._errors[line._error];
+	}
+
+	////////////////////////////////////////////////////////////////
+	// ParallelReader
+
+	ParallelReader::ParallelReader()
+	{
+	}
+
+	ParallelReader::~ParallelReader()
+	{
+	}
+
+	void ParallelReader::set_options(const ParseOptions& options)
+	{
+		_options = options;
+	}
+
+	void ParallelReader::set_thread_count(int count)
+	{
+		if (count != _thread_count)
+			_pool.reset();
+
+		_thread_count = count;
+	}
+
+	void ParallelReader::set_min_size(int bytes)
+	{
+		_min_size = bytes;
+	}
+
+	ThreadPool* ParallelReader::get_pool()
+	{
+		if (!_pool)
+			_pool.reset(new ThreadPool(resolve_thread_count(_thread_count)));
+
+		return _pool.get();
+	}
+
+	bool ParallelReader::parse_serial(const char* text, int text_length, std::string* put_error_here)
+	{
+		std::string error;
+		if (parse_part(_parsed, _scratch, _options, TextSpan(text, text + text_length), _parsed._root, &error))
+			return true;
+
+		if (put_error_here != nullptr)
+			*put_error_here = error;
+		else
+			puts(error.c_str());
+
+		return false;
+	}
+
+	// walk the structural index, the root must be an array that ends the document
+	// the elements are cut at the first top level comma after every slice-size bytes
+	// the slices are parsed with the same index (and the utf-8 is checked while it is made)
+	bool ParallelReader::split(const char* text, int text_length, int slice_count)
+	{
+		int32_t invalid_utf8 = -1;
+		if (!OkJsonScan::build_structural_index(text, text + text_length, _index, _options._validate_utf8 ? &invalid_utf8 : nullptr))
+			return false; // comments
+
+		if (invalid_utf8 >= 0)
+			return false; // the serial parse reports it
+
+		if (_index.size() < 3 || text[_index[0]] != '[')
+			return false;
+
+		int64_t slice_size = text_length / slice_count + 1;
+		int64_t next_cut = slice_size;
+
+		_slice_count = 0;
+		int32_t slice_begin = (int32_t)_index[0] + 1;
+		int depth = 0;
+		size_t i = 0;
+		for (; i + 1 < _index.size(); ++i)
+		{
+			uint32_t at = _index[i];
+			char c = text[at];
+			if (c == '[' || c == '{')
+			{
+				++depth;
+			}
+			else if (c == ']' || c == '}')
+			{
+				if (--depth == 0)
+					break;
+			}
+			else if (c == ',' && depth == 1 && at >= next_cut)
+			{
+				if ((int)_slices.size() <= _slice_count)
+					_slices.emplace_back();
+
+				_slices[_slice_count++]._b = slice_begin;
+				_slices[_slice_count - 1]._e = (int32_t)at;
+				slice_begin = (int32_t)at + 1;
+
+				while (next_cut <= at)
+					next_cut += slice_size;
+			}
+		}
+
+		// the root has to be closed by ']' and be the last token
+		if (depth != 0 || text[_index[i]] != ']' || i + 2 != _index.size())
+			return false;
+
+		if ((int)_slices.size() <= _slice_count)
+			_slices.emplace_back();
+
+		_slices[_slice_count]._b = slice_begin;
+		_slices[_slice_count]._e = (int32_t)_index[i];
+		++_slice_count;
+
+		return _slice_count > 1;
+	}
+
+	bool ParallelReader::parse(const char* text, int text_length, std::string* put_error_here)
+	{
+		if (text_length < 0)
+		{
+			text_length = 0;
+			while (text[text_length] != 0)
+				++text_length;
+		}
+
+		_parsed._text = TextSpan(text, text + text_length);
+		_parsed._array_values.clear();
+		_parsed._object_kvps.clear();
+		_parsed._key_hashes.clear();
+		_parsed._tape.clear();
+		_parsed._object_index_slots.clear();
+		_parsed._object_indices.clear();
+		_parsed._root = { e_null, -1, -1, 0 };
+
+		// the slices are joined by moving nodes, which the tape layout does not have
+		ThreadPool* pool = text_length >= _min_size && !_options._tape ? get_pool() : nullptr;
+
+		// a few slices per thread, so one slow slice does not hold up the rest
+		if (pool == nullptr || pool->get_thread_count() < 2 || !split(text, text_length, pool->get_thread_count() * 4))
+			return parse_serial(text, text_length, put_error_here);
+
+		pool->run(_slice_count, [&](int s)
+		{
+			Slice& slice = _slices[s];
+			slice._parsed._text = _parsed._text;
+			slice._parsed._array_values.clear();
+			slice._parsed._object_kvps.clear();
+			slice._parsed._key_hashes.clear();
+			slice._values.clear();
+
+			bool last = s + 1 == _slice_count;
+			TextSpan part(text + slice._b, text + slice._e);
+			slice._valid = parse_part_elements(slice._parsed, slice._scratch, _options, part, last, slice._values, nullptr, &_index);
+		});
+
+		// invalid documents are parsed again on one thread, to get the same error as Reader::parse
+		int32_t arrays = 0;
+		int32_t objects = 0;
+		int32_t values = 0;
+		for (int s = 0; s < _slice_count; ++s)
+		{
+			Slice& slice = _slices[s];
+			if (!slice._valid)
+			{
+				_parsed._array_values.clear();
+				_parsed._object_kvps.clear();
+				_parsed._key_hashes.clear();
+				return parse_serial(text, text_length, put_error_here);
+			}
+
+			slice._array_base = arrays;
+			slice._object_base = objects;
+			slice._value_base = values;
+			arrays += (int32_t)slice._parsed._array_values.size();
+			objects += (int32_t)slice._parsed._object_kvps.size();
+			values += (int32_t)slice._values.size();
+		}
+
+		// nested nodes of every slice in order, then the elements of the root (as the serial parse adds them)
+		_parsed._array_values.resize((size_t)arrays + values);
+		_parsed._object_kvps.resize(objects);
+		_parsed._key_hashes.resize(objects);
+		_parsed._lazy_numbers = _options._lazy_numbers;
+		_parsed._unescaped = false;
+		_parsed._tape_layout = false;
+		_parsed._object_index_min_size = _options._object_index_min_size;
+		_parsed._root = { e_array, arrays, arrays + values, 0 };
+		_parsed._root._source = { (int32_t)_index[0], _slices[_slice_count - 1]._e + 1 };
+
+		pool->run(_slice_count, [&](int s)
+		{
+			const Slice& slice = _slices[s];
+
+			Value* array_dst = _parsed._array_values.data() + slice._array_base;
+			for (const Value& v : slice._parsed._array_values)
+				*array_dst++ = rebase(v, slice._array_base, slice._object_base);
+
+			KvP* object_dst = _parsed._object_kvps.data() + slice._object_base;
+			for (const KvP& kvp : slice._parsed._object_kvps)
+			{
+				*object_dst = kvp;
+				object_dst->_v = rebase(kvp._v, slice._array_base, slice._object_base);
+				++object_dst;
+			}
+
+			std::copy(slice._parsed._key_hashes.begin(), slice._parsed._key_hashes.end(), _parsed._key_hashes.begin() + slice._object_base);
+
+			Value* value_dst = _parsed._array_values.data() + arrays + slice._value_base;
+			for (const Value& v : slice._values)
+				*value_dst++ = rebase(v, slice._array_base, slice._object_base);
+		});
+
+		return true;
+	}
+
+	Proxy ParallelReader::get_root() const
+	{
+		return Proxy(_parsed._root, &_parsed);
+	}
+};
@@ -0,0 +1,137 @@
+#ifndef OK_JSON_PARALLEL_H
+#define OK_JSON_PARALLEL_H
+
+#include "ok_json_reader.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+namespace OkJsonReader
+{
+	struct ThreadPool;
+
+	// newline delimited json (json lines, ndjson), every line is its own document
+	// lines are found with simd (newlines inside strings do not split), then parsed on a pool of threads
+	// every task adds its lines to its own Parsed, so no memory is shared between threads
+	struct LinesReader
+	{
+		LinesReader();
+		~LinesReader();
+
+		void set_options(const ParseOptions& options);
+
+		// 0 (default) is one thread per core, the pool is kept between calls
+		void set_thread_count(int count);
+
+		// false if any line failed, the first error is put in put_error_here
+		// warning, the proxy-objects will point to the submitted text
+		bool parse(const char* text, int text_length = -1, std::string* put_error_here = nullptr);
+
+		int size() const; // number of lines (lines with only whitespace are skipped)
+		bool is_valid(int i) const;
+		Proxy get_root(int i) const; // null for lines that failed
+		TextSpan get_line(int i) const;
+		const std::string& get_error(int i) const; // empty for valid lines
+
+		struct Iterator
+		{
+			const LinesReader* _reader;
+			int _i;
+
+			Proxy operator*() const { return _reader->get_root(_i); }
+			Iterator& operator++() { ++_i; return *this; }
+			bool operator!=(const Iterator& o) const { return _i != o._i; }
+		};
+
+		Iterator begin() const { return { this, 0 }; }
+		Iterator end() const { return { this, size() }; }
+
+	private:
+		struct Line
+		{
+			int32_t _b; // offsets in the text
+			int32_t _e;
+			int32_t _arena;
+			int32_t _error; // into the arena's errors, -1 if valid
+			Value _root;
+		};
+
+		struct Arena
+		{
+			Parsed _parsed;
+			ParseScratch _scratch;
+			std::vector<std::string> _errors;
+		};
+
+		ThreadPool* get_pool();
+
+		ParseOptions _options;
+		int _thread_count = 0;
+		std::unique_ptr<ThreadPool> _pool;
+
+		TextSpan _text;
+		std::vector<uint32_t> _newlines;
+		std::vector<Line> _lines;
+		std::vector<Arena> _arenas;
+	};
+
+	// one large document where the root is an array (an export, a log written as one array)
+	// the elements are split at the top level commas into slices that are parsed on a pool of threads,
+	// then the slices are joined into one Parsed, laid out exactly as Reader::parse would have done it
+	// small documents, other roots, documents with comments, invalid documents and the tape layout
+	// are parsed on the calling thread
+	struct ParallelReader
+	{
+		ParallelReader();
+		~ParallelReader();
+
+		void set_options(const ParseOptions& options);
+
+		// 0 (default) is one thread per core, the pool is kept between calls
+		void set_thread_count(int count);
+
+		// documents smaller than this are not split
+		void set_min_size(int bytes);
+
+		// warning, the proxy-objects will point to the submitted text
+		bool parse(const char* text, int text_length = -1, std::string* put_error_here = nullptr);
+
+		Proxy get_root() const;
+
+	private:
+		struct Slice
+		{
+			int32_t _b; // offsets in the text, the commas around the slice are not included
+			int32_t _e;
+			bool _valid;
+
+			Parsed _parsed;
+			ParseScratch _scratch;
+			std::vector<Value> _values; // the elements of the root array in this slice
+
+			// where this slice goes in the joined Parsed
+			int32_t _array_base;
+			int32_t _object_base;
+			int32_t _value_base;
+		};
+
+		bool split(const char* text, int text_length, int slice_count);
+		bool parse_serial(const char* text, int text_length, std::string* put_error_here);
+		ThreadPool* get_pool();
+
+		ParseOptions _options;
+		int _thread_count = 0;
+		int _min_size = 1 << 20;
+		std::unique_ptr<ThreadPool> _pool;
+
+		Parsed _parsed;
+		ParseScratch _scratch;
+		std::vector<uint32_t> _index;
+		std::vector<Slice> _slices;
+		int _slice_count = 0; // slices used by the last parse
+	};
+};
+
+#endif // OK_JSON_PARALLEL_H
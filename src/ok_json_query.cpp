@@ -0,0 +1,196 @@
+#include "ok_json_query.h"
+
+#include <cstdio>
+
+namespace OkJsonQuery_Private
+{
+	// digits only, no leading zeros, -1 otherwise ("-" is past the end, never found)
+	int32_t parse_index(const std::string& token)
+	{
+		if (token.empty() || token.size() > 9)
+			return -1;
+
+		if (token.size() > 1 && token[0] == '0')
+			return -1;
+
+		int32_t index = 0;
+		for (char c : token)
+		{
+			if (c < '0' || c > '9')
+				return -1;
+			index = index * 10 + (c - '0');
+		}
+
+		return index;
+	}
+
+	void query_error(std::string* put_error_here, const char* desc, const char* path)
+	{
+		std::string error = desc;
+		error += path;
+
+		if (put_error_here != nullptr)
+			*put_error_here = error;
+		else
+			puts(error.c_str());
+	}
+
+	// the unescaped tokens of a json pointer
+	bool split_pointer(const char* path, std::vector<std::string>& tokens, std::string* put_error_here)
+	{
+		const char* p = path;
+		if (*p != 0 && *p != '/')
+		{
+			query_error(put_error_here, "path needs to start with /: ", path);
+			return false;
+		}
+
+		while (*p == '/')
+		{
+			++p;
+
+			// "~1" is '/' and "~0" is '~'
+			std::string token;
+			for (; *p != 0 && *p != '/'; ++p)
+			{
+				if (*p != '~')
+				{
+					token += *p;
+					continue;
+				}
+
+				++p;
+				if (*p != '0' && *p != '1')
+				{
+					query_error(put_error_here, "~ needs to be followed by 0 or 1: ", path);
+					return false;
+				}
+				token += *p == '0' ? '~' : '/';
+			}
+
+			tokens.push_back(token);
+		}
+
+		return true;
+	}
+}
+
+namespace OkJsonReader
+{
+	using namespace OkJsonQuery_Private;
+
+	Query::Query()
+	{
+		_steps.push_back({ { k_fnv1a_offset_basis, 0 }, -1, -1 });
+	}
+
+	int Query::find_or_add(int parent, const std::string& token)
+	{
+		HashedKeyStripped key { key_hash(token.data(), (int32_t)token.size()), (int32_t)token.size() };
+		int32_t index = parse_index(token);
+
+		// paths are added once, a linear search is fine
+		for (int i = parent + 1; i < (int)_steps.size(); ++i)
+		{
+			const Step& s = _steps[i];
+			if (s._parent == parent && s._key._h == key._h && s._key._s == key._s && s._index == index)
+				return i;
+		}
+
+		_steps.push_back({ key, index, parent });
+		return (int)_steps.size() - 1;
+	}
+
+	int Query::add(const char* path, std::string* put_error_here)
+	{
+		std::vector<std::string> tokens;
+		if (!split_pointer(path, tokens, put_error_here))
+			return -1;
+
+		int at = 0;
+		for (const std::string& token : tokens)
+			at = find_or_add(at, token);
+
+		return at;
+	}
+
+	Proxy Query::apply(const Proxy& p, const Step& step) const
+	{
+		if (step._index >= 0 && p.debug_get_type() == e_array)
+			return p.get_child(step._index);
+
+		return p.get_child(step._key); // null if not an object
+	}
+
+	void Query::evaluate(const Proxy& root, std::vector<Proxy>& results) const
+	{
+		// parents come first, so every step is one lookup in an already found value
+		results.clear();
+		results.reserve(_steps.size());
+		results.push_back(root);
+
+		for (size_t i = 1; i < _steps.size(); ++i)
+		{
+			const Step& step = _steps[i];
+			results.push_back(apply(results[step._parent], step));
+		}
+	}
+
+	Proxy Query::evaluate(const Proxy& root, int handle) const
+	{
+		if (handle < 0)
+			return Proxy({ e_null, -1, -1, 0 }, root._parsed);
+
+		if (handle == 0)
+			return root;
+
+		const Step& step = _steps[handle];
+		return apply(evaluate(root, step._parent), step);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// Projection
+
+	Projection::Projection()
+	{
+		_nodes.push_back({ k_fnv1a_offset_basis, 0, -1, -1, false });
+	}
+
+	bool Projection::add(const char* path, std::string* put_error_here)
+	{
+		std::vector<std::string> tokens;
+		if (!split_pointer(path, tokens, put_error_here))
+			return false;
+
+		int32_t at = 0;
+		for (const std::string& token : tokens)
+		{
+			uint64_t h = key_hash(token.data(), (int32_t)token.size());
+			int32_t size = (int32_t)token.size();
+
+			int32_t child = find_child(at, h, size);
+			if (child < 0)
+			{
+				child = (int32_t)_nodes.size();
+				_nodes.push_back({ h, size, _nodes[at]._first_child, -1, false });
+				_nodes[at]._first_child = child;
+			}
+
+			at = child;
+		}
+
+		_nodes[at]._keep_all = true;
+		return true;
+	}
+
+	int32_t Projection::find_child(int32_t node, uint64_t h, int32_t size) const
+	{
+		for (int32_t i = _nodes[node]._first_child; i >= 0; i = _nodes[i]._next_sibling)
+		{
+			if (_nodes[i]._h == h && _nodes[i]._s == size)
+				return i;
+		}
+
+		return -1;
+	}
+};
@@ -0,0 +1,71 @@
+#ifndef OK_JSON_QUERY_H
+#define OK_JSON_QUERY_H
+
+#include "ok_json_reader.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+namespace OkJsonReader
+{
+	// compiled json pointers (rfc 6901), "/meta/tags/3/name", "" is the whole document
+	// keys are hashed once when added, and all paths share one tree, so a prefix that is
+	// common to many paths ("/meta/...") is only looked up once per evaluate
+	// like HashedKeyStripped, keys match by hash and length, escape codes in the json are not applied
+	struct Query
+	{
+		Query();
+
+		// returns the handle of the path (the same path gives the same handle), -1 if the path is invalid
+		int add(const char* path, std::string* put_error_here = nullptr);
+
+		// results[handle] is the value of that path, null if it is missing
+		void evaluate(const Proxy& root, std::vector<Proxy>& results) const;
+
+		// only the one path, handle 0 is the root (the path "") and -1 (a path that could not be added) gives null
+		Proxy evaluate(const Proxy& root, int handle) const;
+
+	private:
+		struct Step
+		{
+			HashedKeyStripped _key;
+			int32_t _index; // the token as an array index, -1 if it is not a number
+			int32_t _parent; // steps come after their parent
+		};
+
+		int find_or_add(int parent, const std::string& token);
+		Proxy apply(const Proxy& p, const Step& step) const;
+
+		std::vector<Step> _steps; // 0 is the root
+	};
+
+	// the parts of a document to keep when parsing (ParseOptions::_projection)
+	// paths are json pointers of keys, a kept path keeps everything below it, arrays are looked through
+	// ("/items/price" keeps the price of every element of items), everything else is checked but not stored
+	// so an object that is not kept is an empty object in the tree
+	struct Projection
+	{
+		Projection();
+
+		bool add(const char* path, std::string* put_error_here = nullptr);
+
+		// used by the parser, node 0 is the root, -1 if the key is not kept
+		int32_t find_child(int32_t node, uint64_t h, int32_t size) const;
+		bool keeps_all(int32_t node) const { return _nodes[node]._keep_all; }
+
+	private:
+		struct Node
+		{
+			uint64_t _h; // key
+			int32_t _s;
+			int32_t _next_sibling;
+			int32_t _first_child;
+			bool _keep_all;
+		};
+
+		std::vector<Node> _nodes;
+	};
+};
+
+#endif // OK_JSON_QUERY_H
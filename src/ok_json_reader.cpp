@@ -1,55 +1,47 @@
 #include "ok_json_reader.h"
-
-#include <cmath>
+#include "ok_json_internal.h"
+#include "ok_json_number.h"
+#include "ok_json_query.h"
+#include "ok_json_scan.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <string>
+#include <utility>
+
+#if OK_JSON_STATS
+#include <chrono>
+#if defined(__x86_64__) || defined(_M_X64)
+#define OK_JSON_STATS_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define OK_JSON_STATS_TSC 0
+#endif
+#endif
 
-// fixme utf8? (other encoding too?)
-	
-const uint64_t k_fnv1a_mul = 0x00000100000001B3UL;
+#if defined(__unix__) || defined(__APPLE__)
+#define OK_JSON_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define OK_JSON_MMAP 0
+#endif
 
 namespace OkJsonReader_Private
 {
 	using namespace OkJsonReader;
 
-	enum
-	{
-		k_power_table_size = 20
-	};
-
-	double k_power_table[k_power_table_size] = {
-	1.0,
-	10.0,
-	100.0,
-	1000.0,
-	10000.0,
-	100000.0,
-	1000000.0,
-	10000000.0,
-	100000000.0,
-	1000000000.0,
-	10000000000.0,
-	100000000000.0,
-	1000000000000.0,
-	10000000000000.0,
-	100000000000000.0,
-	1000000000000000.0,
-	10000000000000000.0,
-	100000000000000000.0,
-	1000000000000000000.0,
-	10000000000000000000.0,
-	};
-
-	struct ObjectStackElement
-	{
-		std::vector<KvP> _object_kvps;
-	};
-
-	struct ArrayStackElement
-	{
-		std::vector<Value> _array_values;
-	};
-
 	bool calculate_line_col(TextSpan full_text, TextSpan read, int& line, int& col)
 	{
 		const char* s = read._b;
@@ -107,49 +99,362 @@ namespace OkJsonReader_Private
 		return false;
 	}
 
+	int hex_digit(char c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		return -1;
+	}
+
+	// the 4 hex digits after \u
+	bool read_hex4(const char* p, const char* e, uint32_t& v)
+	{
+		if (e - p < 4)
+			return false;
+
+		v = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			int d = hex_digit(p[i]);
+			if (d < 0)
+				return false;
+			v = (v << 4) | (uint32_t)d;
+		}
+		return true;
+	}
+
+	char* write_utf8(char* d, uint32_t c)
+	{
+		if (c < 0x80)
+		{
+			*d++ = (char)c;
+		}
+		else if (c < 0x800)
+		{
+			*d++ = (char)(0xc0 | (c >> 6));
+			*d++ = (char)(0x80 | (c & 0x3f));
+		}
+		else if (c < 0x10000)
+		{
+			*d++ = (char)(0xe0 | (c >> 12));
+			*d++ = (char)(0x80 | ((c >> 6) & 0x3f));
+			*d++ = (char)(0x80 | (c & 0x3f));
+		}
+		else
+		{
+			*d++ = (char)(0xf0 | (c >> 18));
+			*d++ = (char)(0x80 | ((c >> 12) & 0x3f));
+			*d++ = (char)(0x80 | ((c >> 6) & 0x3f));
+			*d++ = (char)(0x80 | (c & 0x3f));
+		}
+		return d;
+	}
+
+#if OK_JSON_STATS
+	// cheap clock for the time split of a parse (converted with the total time, so any unit works)
+	uint64_t stats_ticks()
+	{
+#if OK_JSON_STATS_TSC
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	double stats_seconds()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// adds the ticks spent in its scope
+	struct StatsTimer
+	{
+		uint64_t& _ticks;
+		uint64_t _start;
+
+		StatsTimer(uint64_t& ticks) : _ticks(ticks), _start(stats_ticks()) {}
+		~StatsTimer() { _ticks += stats_ticks() - _start; }
+	};
+
+#define OK_JSON_STATS_TIME(ticks) StatsTimer stats_timer(ticks)
+#else
+#define OK_JSON_STATS_TIME(ticks)
+#endif
+
+	// tape words
+	enum
+	{
+		k_tape_type_shift = 56,
+		k_tape_size_shift = 32,
+		k_tape_size_max = 0xffffff // larger sizes are in the next word (counts of children are walked)
+	};
+
+	uint64_t tape_word(Type t, uint32_t low, uint32_t size)
+	{
+		if (size > k_tape_size_max)
+			size = k_tape_size_max;
+
+		return ((uint64_t)t << k_tape_type_shift) | ((uint64_t)size << k_tape_size_shift) | low;
+	}
+
+	Type tape_type(uint64_t word)
+	{
+		return (Type)(word >> k_tape_type_shift);
+	}
+
+	uint32_t tape_size(uint64_t word)
+	{
+		return (uint32_t)(word >> k_tape_size_shift) & k_tape_size_max;
+	}
+
+	bool is_container(Type t)
+	{
+		return t == e_object || t == e_array;
+	}
+
+	// the value at tape index i (the same as the parser returned for it)
+	Value tape_value(const Parsed& parsed, int32_t i)
+	{
+		const uint64_t* tape = parsed._tape.data();
+		uint64_t word = tape[i];
+		Type t = tape_type(word);
+		if (is_container(t))
+			return { t, i, (int32_t)(uint32_t)word, 0 };
+
+		int32_t b = (int32_t)(uint32_t)word;
+		uint32_t size = tape_size(word);
+		if (size == k_tape_size_max)
+			size = (uint32_t)tape[++i];
+
+		Value v { t, b, b + (int32_t)size, 0 };
+		if ((t == e_int || t == e_number) && !parsed._lazy_numbers)
+			memcpy(&v._int, &tape[i + 1], sizeof(v._int));
+
+		return v;
+	}
+
+	// the index after the value at tape index i
+	int32_t tape_next(const Parsed& parsed, int32_t i)
+	{
+		uint64_t word = parsed._tape[i];
+		Type t = tape_type(word);
+		if (is_container(t))
+			return (int32_t)(uint32_t)word;
+
+		if (tape_size(word) == k_tape_size_max)
+			++i;
+
+		if ((t == e_int || t == e_number) && !parsed._lazy_numbers)
+			++i;
+
+		return i + 1;
+	}
+
+	// open addressing (linear probing), at most half full
+	const ObjectIndex& get_object_index(const Parsed& parsed, int object_begin, int object_end)
+	{
+		auto found = parsed._object_indices.find(object_begin);
+		if (found != parsed._object_indices.end())
+			return found->second;
+
+		uint32_t slot_count = 1;
+		while (slot_count < (uint32_t)(object_end - object_begin) * 2)
+			slot_count *= 2;
+
+		ObjectIndex index;
+		index._slots_begin = (int32_t)parsed._object_index_slots.size();
+		index._mask = slot_count - 1;
+		parsed._object_index_slots.resize(parsed._object_index_slots.size() + slot_count, -1);
+
+		// inserted in order, so the first of duplicate keys is found first (same as the linear search)
+		int32_t* slots = parsed._object_index_slots.data() + index._slots_begin;
+		for (int i = object_begin; i < object_end; ++i)
+		{
+			uint32_t slot = (uint32_t)parsed._key_hashes[i] & index._mask;
+			while (slots[slot] >= 0)
+				slot = (slot + 1) & index._mask;
+
+			slots[slot] = i;
+		}
+
+		return parsed._object_indices.emplace(object_begin, index).first->second;
+	}
+
+	// returns the kvp index or -1, match is only called for keys with the same hash
+	template<typename Match>
+	int find_kvp(const Parsed& parsed, Value object, uint64_t h, Match match)
+	{
+		const uint64_t* hashes = parsed._key_hashes.data();
+		if (object._e - object._b >= parsed._object_index_min_size)
+		{
+			const ObjectIndex& index = get_object_index(parsed, object._b, object._e);
+			const int32_t* slots = parsed._object_index_slots.data() + index._slots_begin;
+			for (uint32_t slot = (uint32_t)h & index._mask; ; slot = (slot + 1) & index._mask)
+			{
+				int32_t i = slots[slot];
+				if (i < 0)
+					return -1;
+
+				if (hashes[i] == h && match(parsed._object_kvps[i]._k))
+					return i;
+			}
+		}
+
+		// compare the hashes with simd, the kvp is only read when one matches
+		for (int i = object._b; i < object._e; ++i)
+		{
+			i += OkJsonScan::find_hash(hashes + i, object._e - i, h);
+			if (i >= object._e)
+				break;
+
+			if (match(parsed._object_kvps[i]._k))
+				return i;
+		}
+
+		return -1;
+	}
+
 	struct Parser
 	{
 		TextSpan _read; // read from here
 
 		Parsed* _dest = nullptr;
+		ParseScratch* _scratch = nullptr; // open containers collect their children here
+
+		// two-stage parse, offsets of all tokens (ends with the text size)
+		const uint32_t* _index = nullptr;
+		const char* _index_base = nullptr; // offsets are from here
+
+		bool _padded = false; // the text is followed by k_padding zero bytes
+		char* _in_situ = nullptr; // the same text but writable, strings are unescaped in it
+
+		// projection, node of the object being parsed (-1 keeps everything)
+		// values of keys outside the projection are parsed with _discard set and not stored
+		const Projection* _projection = nullptr;
+		int32_t _projection_node = -1;
+		bool _discard = false;
+
+		// containers nested deeper fail the parse, parts of an array start at depth 1
+		int _max_depth = 0;
+		int _depth_base = 0;
+
+		int64_t _allocations = 0; // number of times any buffer had to grow
+
+		// a parse in steps stops here, right after a '{', '[' or ',' (null for a parse in one go)
+		const char* _stop = nullptr;
+
+#if OK_JSON_STATS
+		ParseStats _stats;
+		uint64_t _scan_ticks = 0;
+		uint64_t _number_ticks = 0;
+#endif
+
+		// a buffer grew to bytes
+		void grew(size_t bytes)
+		{
+			++_allocations;
+#if OK_JSON_STATS
+			_stats._bytes_allocated += (int64_t)bytes;
+#else
+			(void)bytes;
+#endif
+		}
+
+		template<typename Vector>
+		void push(Vector& dst, const typename Vector::value_type& v)
+		{
+			bool grows = dst.size() == dst.capacity();
+			dst.push_back(v);
+			if (grows)
+				grew(dst.capacity() * sizeof(v));
+		}
 
-		int _parse_depth = 0;
+		// move the top of a scratch-stack (from stack_begin) to the end of dst
+		template<typename Stack, typename Vector>
+		int pop_into(Stack& stack, size_t stack_begin, Vector& dst)
+		{
+			size_t count = stack.size() - stack_begin;
+			bool grows = dst.size() + count > dst.capacity();
+			dst.insert(dst.end(), stack.begin() + stack_begin, stack.end());
+			stack.resize(stack_begin);
+			if (grows)
+				grew(dst.capacity() * sizeof(typename Vector::value_type));
+			return (int)dst.size();
+		}
 
 		// error into
 		bool _error = false;
 		std::string _error_description;
 
+		// move to the first token at or after the current position
+		void jump_to_token()
+		{
+			uint32_t at = (uint32_t)(_read._b - _index_base);
+			while (*_index < at)
+				++_index;
+
+			_read._b = _index_base + *_index;
+		}
+
+		// true if n more bytes can be read (always true for padded text)
+		inline bool has(int n) const
+		{
+			return _padded || _read._e - _read._b >= n;
+		}
+
 		void skip_ws()
 		{
-			for (; _read._b < _read._e; ++_read._b)
+			if (_index != nullptr)
 			{
-				int v = *_read._b;
-				if (!is_ws(v))
+				// the index has every token that follows whitespace (and there are no comments)
+				if (has(1) && is_ws(*_read._b))
+					jump_to_token();
+				return;
+			}
+
+			for (;;)
+			{
+				if (_padded)
 				{
-					if (v == '/')
-					{
-						skip_comment(); // skip until eol, and then keep going (not technically json spec. but very useful)
-					}
-					else
-					{
-						break;
-					}
+					// the padding is not whitespace, no need to check for the end
+					while (is_ws(*_read._b))
+						++_read._b;
 				}
+				else
+				{
+					while (_read._b < _read._e && is_ws(*_read._b))
+						++_read._b;
+				}
+
+				if (!has(1) || *_read._b != '/')
+					return;
+
+				skip_comment(); // skip until eol, and then keep going (not technically json spec. but very useful)
+				if (_error)
+					return;
 			}
 		}
 
 		// loop until "
 		void skip_string()
 		{
-			// fixme escape codes and utf8
+			// the closing quote is the next token
+			if (_index != nullptr)
+			{
+				jump_to_token();
+				return;
+			}
+
 			for (; _read._b < _read._e; ++_read._b)
 			{
-				if (*_read._b == '\"')
-				{
-					// only break if not part of escape code
-					if (_read._b[-1] != '\\')
-						break;
-				}
+				int v = *_read._b;
+				if (v == '\"')
+					break;
+
+				// skip the escaped character
+				if (v == '\\' && _read._b + 1 < _read._e)
+					++_read._b;
 			}
 		}
 
@@ -159,14 +464,31 @@ namespace OkJsonReader_Private
 		{
 			uint64_t h = k_fnv1a_offset_basis;
 
+			if (_index != nullptr)
+			{
+				const char* b = _read._b;
+				jump_to_token();
+				for (; b < _read._b; ++b)
+				{
+					h ^= (int)*b;
+					h *= k_fnv1a_mul;
+				}
+				return h;
+			}
+
 			for (; _read._b < _read._e; ++_read._b)
 			{
 				int v = *_read._b;
 				if (v == '\"')
+					break;
+
+				// escape codes are part of the key (and the hash)
+				if (v == '\\' && _read._b + 1 < _read._e)
 				{
-					// do not break if part of escape code
-					if (_read._b[-1] != '\\')
-						break;
+					h ^= v;
+					h *= k_fnv1a_mul;
+					++_read._b;
+					v = *_read._b;
 				}
 
 				h ^= v;
@@ -176,223 +498,322 @@ namespace OkJsonReader_Private
 			return h;
 		}
 
-		double accept_fraction()
+		// tape layout, the words of strings, keys and scalars
+		void tape_push_span(Type t, int32_t b, int32_t e)
 		{
-			double weight = 1;
-			double v = 0;
-			for (; _read._b < _read._e; ++_read._b)
-			{
-				char c = *_read._b;
-				switch (c)
-				{
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-					weight *= 10;
-					v *= 10;
-					v += (c - '0');
-					break;
-				default:
-					return v / weight;
-				}
-			}
-			return v / weight;
+			uint32_t size = (uint32_t)(e - b);
+			push(_dest->_tape, tape_word(t, (uint32_t)b, size));
+			if (size >= k_tape_size_max)
+				push(_dest->_tape, (uint64_t)size);
 		}
 
-		// loop until not inside number
-		int64_t accept_digits()
+		void tape_push_scalar(const Value& v)
 		{
-			int64_t v = 0;
+			tape_push_span(v._t, v._b, v._e);
 
-			for (; _read._b < _read._e; ++_read._b)
+			if ((v._t == e_int || v._t == e_number) && !_dest->_lazy_numbers)
 			{
-				char c = *_read._b;
-				switch (c)
-				{
-				case '0':
-				case '1':
-				case '2':
-				case '3':
-				case '4':
-				case '5':
-				case '6':
-				case '7':
-				case '8':
-				case '9':
-					v *= 10;
-					v += c - '0';
-					break;
-				default:
-					return v;
-				}
+				uint64_t bits;
+				memcpy(&bits, &v._int, sizeof(bits));
+				push(_dest->_tape, bits);
 			}
-			return v;
 		}
 
-		Key parse_key()
+		// containers are written before their children, then patched when they are done
+		Value tape_close(Type t, size_t at, uint32_t count)
+		{
+			uint32_t end = (uint32_t)_dest->_tape.size();
+			_dest->_tape[at] = tape_word(t, end, count);
+			return { t, (int32_t)at, (int32_t)end, 0 };
+		}
+
+		Key parse_key(uint64_t& key_hash)
 		{
 			// ensure "
 			if (!accept('\"'))
 			{
 				_error = true;
 				line_and_col_to_string(_dest->_text, _read, _error_description, "key needs to start with \"");
-				return { -1, -1, 0 };
+				return { -1, -1 };
 			}
 
 			// set start
 			int key_start = (int)(_read._b - _dest->_text._b);
 
 			// loop until "
-			uint64_t key_hash = skip_key();
+			key_hash = skip_key();
 			if (!accept('\"'))
 			{
 				_error = true;
 				line_and_col_to_string(_dest->_text, _read, _error_description, "key needs to end with \"");
-				return { -1, -1, 0 };
+				return { -1, -1 };
 			}
 
 			// set end
 			int key_end = (int)(_read._b-1 - _dest->_text._b);
 
-			return { key_start, key_end, key_hash };
+			return { key_start, key_end };
 		}
 
-		Value parse_object()
+		// decides if the value of a key is kept, and moves into the projection (the caller restores it)
+		bool enter_key(uint64_t h, Key k)
 		{
-			++_parse_depth;
+			if (_discard || _projection_node < 0)
+				return !_discard;
 
-			// fixme push to object-stack
-			ObjectStackElement o;
-
-			++_read._b; // skip '{'
-			for ( ; _read._b < _read._e ; )
+			int32_t child = _projection->find_child(_projection_node, h, k._e - k._b);
+			if (child < 0)
 			{
-				skip_ws();
+				_discard = true;
+				return false;
+			}
 
-				// empty object? (also allows for trailing comma)
-				if (accept('}'))
-					break;
+			_projection_node = _projection->keeps_all(child) ? -1 : child;
+			return true;
+		}
 
-				Key k = parse_key(); // does not touch the source-text, thus leaves escape codes
-				if (_error)
-				{
+		// containers are parsed without recursion, the open ones are kept on _scratch->_containers
+		// _read is at the '{' or '[' of the outermost one
+		Value parse_containers()
+		{
+			size_t open_base = _scratch->_containers.size();
+
+			if (!open_container())
+				return { e_null, -1, -1, 0 };
+
+			return run_containers(open_base);
+		}
+
+		// the loop of parse_containers, until the containers above open_base are done
+		// or _stop is reached (a parse in steps, the containers stay open for the next step)
+		Value run_containers(size_t open_base)
+		{
+			std::vector<OpenContainer>& open = _scratch->_containers;
+
+			for (;;)
+			{
+				// at a child or at the end of the container on top (also allows for trailing comma)
+				// this is always right after a '{', '[' or ','
+				if (_read._b == _stop)
 					return { e_null, -1, -1, 0 };
-				}
 
 				skip_ws();
-				if (!accept(':'))
-				{
-					_error = true;
-					line_and_col_to_string(_dest->_text, _read, _error_description, "need \":\" after key");
+				if (_error)
 					return { e_null, -1, -1, 0 };
-				}
 
-				// expect :
-				Value v = parse_value();
-				if (_error)
+				Value v;
+				if (accept(open.back()._t == e_object ? '}' : ']'))
 				{
-					return { e_null, -1, -1, 0 };
+					v = close_container();
+					if (open.size() == open_base)
+						return v;
 				}
+				else
+				{
+					if (_read._b >= _read._e)
+					{
+						_error = true;
+						line_and_col_to_string(_dest->_text, _read, _error_description, open.back()._t == e_object ? "object needs to end with }" : "array needs to end with ]");
+						return { e_null, -1, -1, 0 };
+					}
 
-				KvP kvp{k,v};
-				o._object_kvps.push_back(kvp);
+					if (open.back()._t == e_object && !parse_member_key(open.back()))
+						return { e_null, -1, -1, 0 };
 
-				skip_ws();
-				if (accept('}'))
-					break;
+					skip_ws();
+					if (_error)
+						return { e_null, -1, -1, 0 };
 
-				if (!accept(','))
+					// go into the child
+					char c = has(1) ? *_read._b : 0;
+					if (c == '{' || c == '[')
+					{
+						if (!open_container())
+							return { e_null, -1, -1, 0 };
+						continue;
+					}
+
+					v = parse_scalar();
+					if (_error)
+						return { e_null, -1, -1, 0 };
+				}
+
+				// v is a child of the container on top, then a ',' or the end (which makes the container a child)
+				for (;;)
 				{
-					_error = true;
-					line_and_col_to_string(_dest->_text, _read, _error_description, "need \",\" between key-values");
-					return { e_null, -1, -1, 0 }; // null-value is error...
-				};
-			}
+					OpenContainer& parent = open.back();
+					add_child(parent, v);
 
-			// copy kvp from stack to "parsed"
-			int object_begin = (int)_dest->_object_kvps.size();
-			_dest->_object_kvps.insert(_dest->_object_kvps.end(), o._object_kvps.begin(), o._object_kvps.end());
-			int object_end = (int)_dest->_object_kvps.size();
+					skip_ws();
+					if (_error)
+						return { e_null, -1, -1, 0 };
 
-			// fixme pop from object-stack
-			--_parse_depth;
+					if (!accept(parent._t == e_object ? '}' : ']'))
+					{
+						if (!accept(','))
+						{
+							_error = true;
+							line_and_col_to_string(_dest->_text, _read, _error_description, parent._t == e_object ? "need \",\" between key-values" : "need \",\" between values");
+							return { e_null, -1, -1, 0 };
+						}
+						break;
+					}
 
-			// return the value
-			return { e_object, object_begin, object_end, 0 }; // null-value is error...
+					v = close_container();
+					if (open.size() == open_base)
+						return v;
+				}
+			}
 		}
 
-		
-		Value parse_array()
+		bool open_container()
 		{
-			++_parse_depth;
-
-			// fixme push to array-stack
-			ArrayStackElement a;
-
-			++_read._b; // skip '['
-
-			for (; _read._b < _read._e; )
+			std::vector<OpenContainer>& open = _scratch->_containers;
+			if ((int)open.size() + _depth_base >= _max_depth)
 			{
-				skip_ws();
+				_error = true;
+				line_and_col_to_string(_dest->_text, _read, _error_description, "nested too deep (ParseOptions::_max_depth)");
+				return false;
+			}
 
-				// accept empty array?
-				if (accept(']'))
-					break;
+			// children are collected on the shared scratch-stacks until the container is done
+			OpenContainer c;
+			c._t = *_read._b == '{' ? e_object : e_array;
+			c._stack_begin = c._t == e_object ? _scratch->_object_stack.size() : _scratch->_array_stack.size();
 
-				Value v = parse_value();
-				if (_error)
-				{
-					return { e_null, -1, -1, 0 };
-				}
+			// or written to the tape right away
+			c._tape_at = _dest->_tape.size();
+			c._source_b = (int32_t)(_read._b - _dest->_text._b);
+			c._count = 0;
+			if (_dest->_tape_layout && !_discard)
+				push(_dest->_tape, (uint64_t)0);
 
-				a._array_values.push_back(v);
+			push(open, c);
+			++_read._b; // skip '{' or '['
 
-				skip_ws();
+#if OK_JSON_STATS
+			if ((int32_t)open.size() + _depth_base > _stats._max_depth)
+				_stats._max_depth = (int32_t)open.size() + _depth_base;
+#endif
+			return true;
+		}
 
-				// last element?
-				if (accept(']'))
-					break;
+		// "key": of the next kvp of c
+		bool parse_member_key(OpenContainer& c)
+		{
+			c._key_hash = 0;
+			c._key = parse_key(c._key_hash); // does not touch the source-text, thus leaves escape codes
+			if (_error)
+				return false;
 
-				if (!accept(','))
+			skip_ws();
+			if (!accept(':'))
+			{
+				if (!_error)
 				{
 					_error = true;
-					line_and_col_to_string(_dest->_text, _read, _error_description, "need \",\" between values");
-					return { e_null, -1, -1, 0 }; // null-value is error...
+					line_and_col_to_string(_dest->_text, _read, _error_description, "need \":\" after key");
 				}
+				return false;
 			}
 
-			// copy kvp from stack to "parsed"
-			int array_begin = (int)_dest->_array_values.size();
-			_dest->_array_values.insert(_dest->_array_values.end(), a._array_values.begin(), a._array_values.end());
-			int array_end = (int)_dest->_array_values.size();
+			// restored when the value is added
+			c._projection_node = _projection_node;
+			c._discard = _discard;
+			c._keep = enter_key(c._key_hash, c._key);
 
-			// fixme pop from object-stack
-			--_parse_depth;
+			if (c._keep && _dest->_tape_layout)
+				tape_push_span(e_string, c._key._b, c._key._e);
 
-			// return the value
-			return { e_array, array_begin, array_end, 0 }; // null-value is error...
+			return true;
 		}
 
-		void skip_comment()
+		void add_child(OpenContainer& c, const Value& v)
 		{
-			// skip past '/'
-			++_read._b;
+			if (c._t == e_object)
+			{
+				_projection_node = c._projection_node;
+				_discard = c._discard;
 
-			if (!accept('/'))
+				if (!c._keep)
+					return; // checked, not stored
+			}
+			else if (_discard)
 			{
-				_error = true;
-				line_and_col_to_string(_dest->_text, _read, _error_description, "comment starts with //");
 				return;
 			}
 
-			// find newline
+#if OK_JSON_STATS
+			++_stats._values;
+			if (c._t == e_object)
+				++_stats._kvps;
+#endif
+
+			if (_dest->_tape_layout)
+			{
+				if (!is_container(v._t))
+					tape_push_scalar(v);
+				++c._count;
+				return;
+			}
+
+			if (c._t == e_object)
+			{
+				KvP kvp{ c._key, v };
+				push(_scratch->_object_stack, kvp);
+				push(_scratch->_key_hash_stack, c._key_hash);
+			}
+			else
+			{
+				push(_scratch->_array_stack, v);
+			}
+		}
+
+		Value close_container()
+		{
+			std::vector<OpenContainer>& open = _scratch->_containers;
+			OpenContainer c = open.back();
+			open.pop_back();
+
+			if (_discard)
+				return { e_null, -1, -1, 0 };
+
+			if (_dest->_tape_layout)
+				return tape_close(c._t, c._tape_at, c._count);
+
+			// copy the children from the stack to "parsed"
+			Value v;
+			v._t = c._t;
+			if (c._t == e_object)
+			{
+				v._b = (int32_t)_dest->_object_kvps.size();
+				v._e = pop_into(_scratch->_object_stack, c._stack_begin, _dest->_object_kvps);
+				pop_into(_scratch->_key_hash_stack, c._stack_begin, _dest->_key_hashes);
+			}
+			else
+			{
+				v._b = (int32_t)_dest->_array_values.size();
+				v._e = pop_into(_scratch->_array_stack, c._stack_begin, _dest->_array_values);
+			}
+
+			// _read is after the closing bracket
+			v._source = { c._source_b, (int32_t)(_read._b - _dest->_text._b) };
+			return v;
+		}
+
+		void skip_comment()
+		{
+			// skip past '/'
+			++_read._b;
+
+			if (!accept('/'))
+			{
+				_error = true;
+				line_and_col_to_string(_dest->_text, _read, _error_description, "comment starts with //");
+				return;
+			}
+
+			// find newline
 			for (; _read._b < _read._e; ++_read._b)
 			{
 				int v = *_read._b;
@@ -423,15 +844,38 @@ namespace OkJsonReader_Private
 			// set end
 			int string_end = (int)(_read._b - 1 - _dest->_text._b);
 
+			if (_in_situ != nullptr && !_discard)
+				string_end = unescape_in_situ(string_start, string_end);
+
 			return { e_string, string_start, string_end, 0 };
 		}
 
+		// applies the escape codes of a string in the text, returns the new end
+		// the rest of the string up to the quote is left as it was (nothing points there)
+		int unescape_in_situ(int string_start, int string_end)
+		{
+			char* b = _in_situ + string_start;
+			if (memchr(b, '\\', (size_t)(string_end - string_start)) == nullptr)
+				return string_end;
+
+			int size = Proxy::unescape({ b, _in_situ + string_end }, b);
+			if (size < 0)
+			{
+				_error = true;
+				line_and_col_to_string(_dest->_text, _read, _error_description, "invalid escape code in string");
+				return string_end;
+			}
+
+			return string_start + size;
+		}
+
 		Value parse_true()
 		{
 			// skip past 't'
 			++_read._b;
 
 			if (
+				!has(3) ||
 				_read._b[0] != 'r' ||
 				_read._b[1] != 'u' ||
 				_read._b[2] != 'e'
@@ -454,6 +898,7 @@ namespace OkJsonReader_Private
 			++_read._b;
 
 			if (
+				!has(4) ||
 				_read._b[0] != 'a' ||
 				_read._b[1] != 'l' ||
 				_read._b[2] != 's' ||
@@ -471,10 +916,9 @@ namespace OkJsonReader_Private
 			return { e_false, false_end - 5, false_end, 0 };
 		}
 
-		inline bool accept(char v1, char v2)
+		inline bool accept(char v)
 		{
-			int v = *_read._b;
-			bool r = (v == v1) || (v == v2);
+			bool r = has(1) && *_read._b == v;
 			if (r)
 			{
 				++_read._b;
@@ -482,88 +926,56 @@ namespace OkJsonReader_Private
 			return r;
 		}
 
-		inline bool accept(char v)
+		// remember where the number is, convert it later
+		Value skip_number()
 		{
-			bool r = *_read._b == v;
-			if (r)
+			const char* number_start = _read._b;
+
+			bool has_fraction_or_exponent;
+			if (!OkJsonNumber::skip(_read._b, _read._e, has_fraction_or_exponent))
 			{
-				++_read._b;
+				_error = true;
+				line_and_col_to_string(_dest->_text, _read, _error_description, "invalid number");
+				return { e_null, -1, -1, 0 };
 			}
-			return r;
+
+			int number_begin = (int)(number_start - _dest->_text._b);
+			int number_end = (int)(_read._b - _dest->_text._b);
+			return { has_fraction_or_exponent ? e_number : e_int, number_begin, number_end, 0 };
 		}
 
 		Value parse_number()
 		{
-			int number_start = (int)(_read._b - _dest->_text._b);
+			if (_dest->_lazy_numbers || _discard)
+				return skip_number();
 
-			Type number_type = e_int; // a convenience...
-			int64_t whole = 0;
-			double fraction = 0;
+			OK_JSON_STATS_TIME(_number_ticks);
+#if OK_JSON_STATS
+			++_stats._numbers;
+#endif
 
-			bool flip_sign = accept('-');
-			bool leading_zero = accept('0');
-			if (!leading_zero)
-			{
-				// digits until 
-				whole = accept_digits();
-			}
+			const char* number_start = _read._b;
 
-			bool has_fraction = accept('.');
-			if (has_fraction)
+			OkJsonNumber::Decimal d;
+			if (!OkJsonNumber::scan(_read._b, _read._e, d))
 			{
-				// fixme this could be better if we did the exponent-shifting while parsing these (since it could end up as a large number)
-				// digits
-				fraction = accept_fraction();
-				if (fraction != 0.0)
-				{
-					number_type = e_number;
-				}
+				_error = true;
+				line_and_col_to_string(_dest->_text, _read, _error_description, "invalid number");
+				return { e_null, -1, -1, 0 };
 			}
 
-			double v = whole + fraction;
-
-			bool has_exponent = accept('e','E');
-			if (has_exponent)
-			{
-				// +/-
-				bool flip_exponent_sign = accept('-');
-				bool dummy = accept('+');
-				(void)dummy; // unused
-
-				// digits again
-				int64_t exponent = accept_digits();
-				if (exponent != 0.0)
-				{
-					double mul;
-					if (exponent < k_power_table_size)
-					{
-						mul = k_power_table[exponent];
-					}
-					else
-					{
-						number_type = e_number;
-						mul = pow(10.0, (double)exponent);
-					}
-
-					if (flip_exponent_sign)
-					{
-						number_type = e_number;
-						v /= mul;
-					}
-					else
-					{
-						v *= mul;
-					}
-				}
-			}
+			int number_begin = (int)(number_start - _dest->_text._b);
+			int number_end = (int)(_read._b - _dest->_text._b);
 
-			if (flip_sign)
-			{
-				v = -v;
-			}
+			// integers are kept exact, everything else is a correctly rounded double
+			// -0 is kept as a double (with its sign)
+			Value v { e_int, number_begin, number_end, 0 };
+			if (!OkJsonNumber::is_negative_zero(d) && OkJsonNumber::to_int64(d, v._int))
+				return v;
 
-			int number_end = (int)(_read._b - _dest->_text._b);
-			return { number_type, number_start, number_end, v };
+			v._t = e_number;
+			v._number = OkJsonNumber::to_double(d, number_start, _read._b);
+			return v;
 		}
 
 		Value parse_null()
@@ -572,6 +984,7 @@ namespace OkJsonReader_Private
 			++_read._b;
 
 			if (
+				!has(3) ||
 				_read._b[0] != 'u' ||
 				_read._b[1] != 'l' ||
 				_read._b[2] != 'l'
@@ -591,12 +1004,24 @@ namespace OkJsonReader_Private
 		Value parse_value()
 		{
 			skip_ws();
+			if (_error)
+				return { e_null, -1, -1, 0 };
 
 			// find non-ws
-			switch (*_read._b)
+			switch (has(1) ? *_read._b : 0)
+			{
+			case '{':
+			case '[':
+				return parse_containers();
+			}
+
+			return parse_scalar();
+		}
+
+		Value parse_scalar()
+		{
+			switch (has(1) ? *_read._b : 0)
 			{
-			case '{': return parse_object();
-			case '[': return parse_array();
 			case 't': return parse_true();
 			case 'f': return parse_false();
 			case 'n': return parse_null();
@@ -623,15 +1048,180 @@ namespace OkJsonReader_Private
 			return { e_null, -1, -1, 0 }; // null-value is error...
 		}
 
-		// can scan and count the numbers of { and } to guess the sizes
-		void parse(TextSpan text, Parsed* dest)
+		void utf8_error(TextSpan text, int32_t offset)
+		{
+			std::string desc = "invalid utf-8 at offset ";
+			desc += std::to_string(text._b + offset - _dest->_text._b);
+
+			_error = true;
+			line_and_col_to_string(_dest->_text, { text._b + offset, text._e }, _error_description, desc.c_str());
+		}
+
+		// a pass of its own, when there is no structural index to do it with
+		void check_utf8(TextSpan text, const ParseOptions& options)
+		{
+			if (!options._validate_utf8)
+				return;
+
+			int32_t invalid = OkJsonScan::find_invalid_utf8(text._b, text._e);
+			if (invalid >= 0)
+				utf8_error(text, invalid);
+		}
+
+		// room for count more nodes in dst
+		template<typename Vector>
+		void reserve(Vector& dst, int64_t count)
+		{
+			size_t size = dst.size() + (size_t)count;
+			if (size <= dst.capacity())
+				return;
+
+			dst.reserve(size);
+			grew(dst.capacity() * sizeof(typename Vector::value_type));
+		}
+
+		// a node needs at least one token (a kvp at least three), so a tree that kept more capacity
+		// than that from an earlier parse does not need the tokens counted
+		bool has_room(int64_t tokens) const
+		{
+			if (_dest->_tape_layout)
+				return _dest->_tape.capacity() - _dest->_tape.size() >= (size_t)tokens * 2;
+
+			return _dest->_array_values.capacity() - _dest->_array_values.size() >= (size_t)tokens
+				&& _dest->_object_kvps.capacity() - _dest->_object_kvps.size() >= (size_t)tokens / 3
+				&& _dest->_key_hashes.capacity() - _dest->_key_hashes.size() >= (size_t)tokens / 3;
+		}
+
+		// every node the tokens can make (empty containers and trailing commas make this a bit more)
+		// kvps are one per ':', array elements one per ',' that is not between kvps plus one per array
+		void presize(const OkJsonScan::TokenCounts& counts)
+		{
+			if (_dest->_tape_layout)
+			{
+				// a word per value and key, numbers have two
+				reserve(_dest->_tape, counts._quotes / 2 + counts._scalars * 2 + counts._arrays + counts._objects + 1);
+				return;
+			}
+
+			int64_t elements = counts._commas - counts._colons + counts._objects + counts._arrays;
+			reserve(_dest->_array_values, elements > 0 ? elements : 0);
+			reserve(_dest->_object_kvps, counts._colons);
+			reserve(_dest->_key_hashes, counts._colons);
+		}
+
+		// stage 1, returns false if the one-stage parse has to be used
+		// also checks the utf-8 (ParseOptions::_validate_utf8)
+		// and reserves the nodes (ParseOptions::_presize)
+		bool build_index(TextSpan text, const ParseOptions& options)
+		{
+			OK_JSON_STATS_TIME(_scan_ticks);
+
+			_index = nullptr;
+
+			if (!options._structural_index || text._e - text._b < options._structural_index_min_size)
+			{
+				check_utf8(text, options);
+				return false;
+			}
+
+			std::vector<uint32_t>& index = _scratch->_structural_index;
+			size_t capacity = index.capacity();
+			int32_t invalid_utf8 = -1;
+			bool usable = OkJsonScan::build_structural_index(text._b, text._e, index, options._validate_utf8 ? &invalid_utf8 : nullptr);
+			if (index.capacity() != capacity)
+				grew(index.capacity() * sizeof(uint32_t));
+
+			if (!usable)
+			{
+				check_utf8(text, options);
+				return false;
+			}
+
+			_index = index.data();
+			_index_base = text._b;
+
+			if (invalid_utf8 >= 0)
+			{
+				utf8_error(text, invalid_utf8);
+				return true;
+			}
+
+			if (options._presize && _projection == nullptr && !has_room((int64_t)index.size() - 1))
+			{
+				OkJsonScan::TokenCounts counts;
+				OkJsonScan::count_tokens(text._b, index, counts);
+				presize(counts);
+			}
+
+			return true;
+		}
+
+		// the structural index of all of _dest->_text is already there, part ends at one of its tokens
+		void use_index(TextSpan part, const std::vector<uint32_t>& index, const ParseOptions& options)
+		{
+			OK_JSON_STATS_TIME(_scan_ticks);
+
+			const uint32_t* end = index.data() + index.size();
+			const uint32_t* first = std::lower_bound(index.data(), end, (uint32_t)(part._b - _dest->_text._b));
+			const uint32_t* last = std::lower_bound(first, end, (uint32_t)(part._e - _dest->_text._b));
+
+			_index = first;
+			_index_base = _dest->_text._b;
+
+			if (options._presize && _projection == nullptr && !has_room(last - first))
+			{
+				OkJsonScan::TokenCounts counts;
+				OkJsonScan::count_tokens(_index_base, first, last, counts);
+				presize(counts);
+			}
+		}
+
+		void begin(Parsed* dest, ParseScratch* scratch, const ParseOptions& options, bool padded)
 		{
 			_dest = dest;
+			_scratch = scratch;
+			_padded = padded;
+
+			_scratch->_array_stack.clear();
+			_scratch->_object_stack.clear();
+			_scratch->_key_hash_stack.clear();
+			_scratch->_containers.clear();
+			_max_depth = options._max_depth;
+
+			_dest->_lazy_numbers = options._lazy_numbers;
+			_dest->_object_index_min_size = options._object_index_min_size;
+			_dest->_tape_layout = options._tape;
+			_dest->_unescaped = _in_situ != nullptr;
+
+			_projection = options._projection;
+			_projection_node = _projection != nullptr && !_projection->keeps_all(0) ? 0 : -1;
+			_discard = false;
+		}
 
-			_dest->_text = text;
-			_read = text;
+		// one value (and nothing else) from part, its nodes are added to the end of _dest
+		Value parse_root(TextSpan part, const ParseOptions& options)
+		{
+			_read = part;
+
+			build_index(part, options);
+
+			Value root = parse_value();
+			if (_error)
+				return root;
+
+			end_root(root);
+			return root;
+		}
 
-			_dest->_root = parse_value();
+		// after the root value there can only be whitespace
+		void end_root(const Value& root)
+		{
+#if OK_JSON_STATS
+			++_stats._values;
+#endif
+
+			if (_dest->_tape_layout && !is_container(root._t))
+				tape_push_scalar(root);
 
 			// at this point we really expect EOF
 			skip_ws();
@@ -642,70 +1232,193 @@ namespace OkJsonReader_Private
 				line_and_col_to_string(_dest->_text, _read, _error_description, "expecting EOF");
 			}
 		}
-	};
-}
 
+		// a step of a parse in steps (parse_step), from progress to stop (null for the last step)
+		// the text so far is _dest->_text, the open containers are on the scratch
+		void parse_step(ParseProgress& progress, const char* stop, const ParseOptions& options)
+		{
+			_read = { _dest->_text._b + progress._read, stop != nullptr ? stop : _dest->_text._e };
+			_stop = stop;
+			if (progress._started)
+			{
+				_projection_node = progress._projection_node;
+				_discard = progress._discard;
+			}
 
+			// the steps end after a bracket or a comma, so no utf-8 sequence is split between them
+			check_utf8(_read, options);
+			if (_error)
+				return;
 
-namespace OkJsonReader
-{
-	const TextSpan k_array_str("array can not be viewed as string");
-	const TextSpan k_object_str("object can not be viewed as string");
-	const TextSpan k_null_str("null can not be viewed as string");
+			Value root = progress._started ? run_containers(0) : parse_value();
+			if (_error)
+				return;
 
-	using namespace OkJsonReader_Private;
+			if (stop == nullptr)
+			{
+				end_root(root);
+				_dest->_root = root;
+				return;
+			}
 
-	HashedKeyStripped HashedKeyStripped::from_string(const char* text)
-	{
-		int i = 0;
-		uint64_t h = k_fnv1a_offset_basis;
+			// stopped in the root container
+			progress._read = (int32_t)(stop - _dest->_text._b);
+			progress._projection_node = _projection_node;
+			progress._discard = _discard;
+			progress._started = true;
+		}
 
-		for (; ; ++i)
+		// comma separated values (a slice of the elements of a large array), added to values
+		// the last slice may be empty or end with a comma (the array allows a trailing comma)
+		void parse_elements(TextSpan part, const ParseOptions& options, bool last, std::vector<Value>& values, const std::vector<uint32_t>* index)
 		{
-			int v = text[i];
-			if (v == 0)
-				break;
+			_read = part;
+			_depth_base = 1; // inside the root array
+
+			if (index != nullptr)
+				use_index(part, *index, options);
+			else
+				build_index(part, options);
+
+			skip_ws();
+			if (last && _read._b >= _read._e)
+				return;
+
+			for (;;)
+			{
+				Value v = parse_value();
+				if (_error)
+					return;
 
-			h ^= v;
-			h *= k_fnv1a_mul;
+				push(values, v);
+#if OK_JSON_STATS
+				++_stats._values;
+#endif
+
+				skip_ws();
+				if (_read._b >= _read._e)
+					return;
+
+				if (!accept(','))
+				{
+					_error = true;
+					line_and_col_to_string(_dest->_text, _read, _error_description, "need \",\" between values");
+					return;
+				}
+
+				skip_ws();
+				if (last && _read._b >= _read._e)
+					return;
+			}
 		}
 
-		HashedKeyStripped ret;
-		ret._s = i;
-		ret._h = h;
-		return ret;
-	}
+#if OK_JSON_STATS
+		// ticks and seconds of the whole parse, the ticks of the parts are turned into seconds with them
+		void end_stats(TextSpan text, uint64_t ticks, double seconds, ParseStats& stats)
+		{
+			_stats._bytes = text._e - text._b;
+			_stats._allocations = _allocations;
+			_stats._seconds_total = seconds;
 
-	HashedKey::HashedKey(const char* text)
-	{
-		_b = text;
-		
-		int i = 0;
-		uint64_t h = k_fnv1a_offset_basis;
+			if (ticks != 0)
+			{
+				double seconds_per_tick = seconds / (double)ticks;
+				_stats._seconds_scan = (double)_scan_ticks * seconds_per_tick;
+				_stats._seconds_numbers = (double)_number_ticks * seconds_per_tick;
+			}
 
-		for (; ; ++i)
+			_stats._seconds_tree = seconds - _stats._seconds_scan - _stats._seconds_numbers;
+			if (_stats._seconds_tree < 0.0)
+				_stats._seconds_tree = 0.0;
+
+			stats = _stats;
+		}
+#endif
+
+		void parse(TextSpan text, Parsed* dest, ParseScratch* scratch, const ParseOptions& options, bool padded)
 		{
-			int v = text[i];
-			if (v == 0)
-				break;
+			begin(dest, scratch, options, padded);
+			clear_nodes();
 
-			h ^= v;
-			h *= k_fnv1a_mul;
+			_dest->_text = text;
+			_dest->_root = parse_root(text, options);
 		}
 
-		_s = i;
-		_h = h;
+		// keep the capacity from earlier parses
+		void clear_nodes()
+		{
+			_dest->_array_values.clear();
+			_dest->_object_kvps.clear();
+			_dest->_key_hashes.clear();
+			_dest->_tape.clear();
+			_dest->_object_index_slots.clear();
+			_dest->_object_indices.clear();
+		}
 	};
 
+	// frees the memory of a buffer, swapped with an empty one on the same resource
+	// (assigning an empty one would keep the capacity when the resources differ)
+	template<typename T>
+	void release_buffer(T& buffer)
+	{
+		T(buffer.get_allocator()).swap(buffer);
+	}
+
+	// "-0" is a double (it keeps its sign) but still an integer, other numbers that are 0.0 are not
+	// (1e-400, 0.5e-330)
+	bool is_integer_zero(const Parsed* parsed, const Value& v)
+	{
+		return v._t == e_number && v._number == 0.0 && v._e - v._b == 2 && memcmp(parsed->_text._b + v._b, "-0", 2) == 0;
+	}
+}
+
+
+
+namespace OkJsonReader
+{
+	const TextSpan k_array_str("array can not be viewed as string");
+	const TextSpan k_object_str("object can not be viewed as string");
+	const TextSpan k_null_str("null can not be viewed as string");
+
+	using namespace OkJsonReader_Private;
+
 //	static std::string unescape(TextSpan text); // applies escape-codes
 
 	// Value Proxy
 	Proxy::Proxy(Value value, const Parsed* parsed)
 		: _value(value)
 		, _parsed(parsed)
+		, _number_ready(!parsed->_lazy_numbers)
 	{
 	};
 
+	void Proxy::convert_lazy_number() const
+	{
+		if (_number_ready)
+			return;
+
+		_number_ready = true;
+
+		if (_value._t != e_int && _value._t != e_number)
+			return;
+
+		// same as the eager parse, the syntax was already checked
+		const char* b = _parsed->_text._b + _value._b;
+		const char* e = _parsed->_text._b + _value._e;
+		const char* p = b;
+		OkJsonNumber::Decimal d;
+		OkJsonNumber::scan(p, e, d);
+
+		if (!OkJsonNumber::is_negative_zero(d) && OkJsonNumber::to_int64(d, _value._int))
+		{
+			_value._t = e_int;
+			return;
+		}
+
+		_value._t = e_number;
+		_value._number = OkJsonNumber::to_double(d, b, e);
+	}
+
 	Type Proxy::debug_get_type() const
 	{
 		return _value._t;
@@ -725,62 +1438,113 @@ namespace OkJsonReader
 		return TextSpan( text + _value._b, text + _value._e );
 	}
 
-#if 0
-	escape
-		'"'
-		'\\'
-		'/'
-		'b'
-		'f'
-		'n'
-		'r'
-		't'
-		'u' hex hex hex hex
-#endif
-
-	std::string Proxy::unescape(TextSpan text)
+	TextSpan Proxy::get_source() const
 	{
-		// copy and undo escape code
-		std::string r;
-		ptrdiff_t lim = text._e - text._b;
-		r.reserve(lim);
+		const char* text = _parsed->_text._b;
+		switch (_value._t)
+		{
+		case e_array:
+		case e_object:
+			if (_parsed->_tape_layout)
+				return TextSpan();
+			return TextSpan(text + _value._source._b, text + _value._source._e);
+		case e_string:
+			return TextSpan(text + _value._b - 1, text + _value._e + 1);
+		default:
+			break;
+		}
+
+		if (_value._b < 0)
+			return TextSpan(); // missing
 
-		const char* b = text._b;
-		for (ptrdiff_t i = 0; i < lim; ++i)
+		return TextSpan(text + _value._b, text + _value._e);
+	}
+
+	int Proxy::unescape(TextSpan text, char* dst)
+	{
+		const char* p = text._b;
+		const char* e = text._e;
+		char* d = dst;
+		for (;;)
 		{
-			int v = b[i];
-			if (v == '\\')
+			// copy up to the next escape in one go (memchr is vectorized)
+			const char* escape = (const char*)memchr(p, '\\', (size_t)(e - p));
+			if (escape == nullptr)
+				escape = e;
+
+			if (d != p)
+				memmove(d, p, (size_t)(escape - p));
+			d += escape - p;
+			p = escape;
+
+			if (p >= e)
+				break;
+
+			// skip past '\\'
+			++p;
+			if (p >= e)
+				return -1;
+
+			char v = *p++;
+			switch (v)
 			{
-				// escape
-				++i;
-				if (i >= lim)
-				{
-					return r;
-				}
-				v = b[i];
-				switch (v)
+			case '\"':
+			case '\\':
+			case '/':
+				*d++ = v;
+				break;
+
+			case 'b': *d++ = '\b'; break;
+			case 'f': *d++ = '\f'; break;
+			case 'n': *d++ = '\n'; break;
+			case 'r': *d++ = '\r'; break;
+			case 't': *d++ = '\t'; break;
+
+			case 'u':
 				{
-				case '\"': break;
-				case '\\': break;
-				case '/': break;
-
-				case 'b': v = '\b'; break;
-				case 'f': v = '\f'; break;
-				case 'n': v = '\n'; break;
-				case 'r': v = '\r'; break;
-				case 't': v = '\t'; break;
-				case 'u': break; // fixme
-
-				default:
-					// bug?
-					return r;
-					break;
+					uint32_t c;
+					if (!read_hex4(p, e, c))
+						return -1;
+					p += 4;
+
+					// utf-16 surrogate pair, a high surrogate then a low one
+					if (c >= 0xd800 && c < 0xdc00)
+					{
+						uint32_t low;
+						if (e - p >= 6 && p[0] == '\\' && p[1] == 'u' && read_hex4(p + 2, e, low) && low >= 0xdc00 && low < 0xe000)
+						{
+							c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+							p += 6;
+						}
+						else
+						{
+							c = 0xfffd;
+						}
+					}
+					else if (c >= 0xdc00 && c < 0xe000)
+					{
+						c = 0xfffd;
+					}
+
+					// never longer than the escape code it came from
+					d = write_utf8(d, c);
 				}
-			}
+				break;
 
-			r.push_back(v);
+			default:
+				return -1;
+			}
 		}
 
+		return (int)(d - dst);
+	}
+
+	std::string Proxy::unescape(TextSpan text)
+	{
+		std::string r;
+		r.resize((size_t)(text._e - text._b));
+		int size = unescape(text, &r[0]);
+		r.resize(size < 0 ? 0 : (size_t)size);
 		return r;
 	}
 
@@ -810,7 +1574,24 @@ namespace OkJsonReader
 		case e_string:
 			{
 			const char* text = _parsed->_text._b;
-			v.assign(text + _value._b, text + _value._e);
+			TextSpan raw(text + _value._b, text + _value._e);
+			size_t size = (size_t)(raw._e - raw._b);
+
+			// most strings have no escape codes
+			if (_parsed->_unescaped || memchr(raw._b, '\\', size) == nullptr)
+			{
+				v.assign(raw._b, raw._e);
+				return true;
+			}
+
+			v.resize(size);
+			int unescaped_size = unescape(raw, &v[0]);
+			if (unescaped_size < 0)
+			{
+				v.clear();
+				return false;
+			}
+			v.resize((size_t)unescaped_size);
 			}
 			return true;
 
@@ -820,50 +1601,110 @@ namespace OkJsonReader
 		return false;
 	}
 
-	bool Proxy::try_get(bool& v) const
+	bool Proxy::try_get(bool& v) const
+	{
+		switch (_value._t)
+		{
+		case e_true:
+			v = true;
+			return true;
+
+		case e_false:
+			v = false;
+			return true;
+
+		default:break;
+		}
+
+		// fixme consider auto convert int to bool?
+		return false;
+	}
+
+	bool Proxy::try_get(int& v) const
+	{
+		convert_lazy_number();
+
+		switch (_value._t)
+		{
+		case e_int:
+			v = (int)_value._int;
+			return true;
+
+		case e_number:
+			if (!is_integer_zero(_parsed, _value))
+				puts("warning truncating number into int"); // maybe settings for runtime-warnings?
+			v = (int)_value._number;
+			return true;
+
+		default:break;
+		}
+
+		// fixme consider auto convert bool to int?
+		return false;
+	}
+
+	bool Proxy::try_get(int64_t& v) const
 	{
+		convert_lazy_number();
+
 		switch (_value._t)
 		{
-		case e_true:
-			v = true;
+		case e_int:
+			v = _value._int;
 			return true;
 
-		case e_false:
-			v = false;
+		case e_number:
+			if (!is_integer_zero(_parsed, _value))
+				break;
+
+			v = 0;
 			return true;
 
 		default:break;
 		}
 
-		// fixme consider auto convert int to bool?
+		// numbers that are not e_int are either fractions or out of range (or -0)
 		return false;
 	}
 
-	bool Proxy::try_get(int& v) const
+	bool Proxy::try_get(uint64_t& v) const
 	{
+		convert_lazy_number();
+
 		switch (_value._t)
 		{
 		case e_int:
-			v = (int)_value._number;
+			if (_value._int < 0)
+				return false;
+
+			v = (uint64_t)_value._int;
 			return true;
 
 		case e_number:
-			puts("warning truncating number into int"); // maybe settings for runtime-warnings?
-			v = (int)_value._number;
-			return true;
+			{
+			// integers above int64 are stored as e_number, read them again from the text
+			const char* b = _parsed->_text._b + _value._b;
+			const char* e = _parsed->_text._b + _value._e;
+			OkJsonNumber::Decimal d;
+			return OkJsonNumber::scan(b, e, d) && OkJsonNumber::to_uint64(d, v);
+			}
 
 		default:break;
 		}
 
-		// fixme consider auto convert bool to int?
 		return false;
 	}
 
 	bool Proxy::try_get(double& v) const
 	{
+		convert_lazy_number();
+
 		switch (_value._t)
 		{
 		case e_int:
+			v = (double)_value._int;
+			return true;
+
 		case e_number:
 			v = _value._number;
 			return true;
@@ -876,17 +1717,12 @@ namespace OkJsonReader
 
 	bool Proxy::try_get(float& v) const
 	{
-		switch (_value._t)
-		{
-		case e_int:
-		case e_number:
-			v = (float)_value._number;
-			return true;
-
-		default:break;
-		}
+		double d;
+		if (!try_get(d))
+			return false;
 
-		return false;
+		v = (float)d;
+		return true;
 	}
 
 
@@ -895,18 +1731,85 @@ namespace OkJsonReader
 
 	int Proxy::size() const
 	{
+		if (_parsed->_tape_layout && is_container(_value._t))
+		{
+			uint32_t count = tape_size(_parsed->_tape[_value._b]);
+			if (count < k_tape_size_max)
+				return (int)count;
+
+			// too many to fit in the word
+			int i = count;
+			while (tape_child(i) >= 0)
+				++i;
+			return i;
+		}
+
 		return _value._e - _value._b;
 	}
 
+	// tape index of child i (the key in an object), -1 if there is none
+	int32_t Proxy::tape_child(int i) const
+	{
+		if (!is_container(_value._t) || i < 0)
+			return -1;
+
+		// continue from the last child found if it is not past i
+		int at_i = 0;
+		int32_t at = _value._b + 1;
+		if (_tape_i >= 0 && _tape_i <= i)
+		{
+			at_i = _tape_i;
+			at = _tape_at;
+		}
+
+		bool object = _value._t == e_object;
+		for (; at < _value._e; ++at_i)
+		{
+			if (at_i == i)
+			{
+				_tape_i = i;
+				_tape_at = at;
+				return at;
+			}
+
+			if (object)
+				at = tape_next(*_parsed, at); // key
+			at = tape_next(*_parsed, at);
+		}
+
+		return -1;
+	}
+
 	TextSpan Proxy::get_key(int i) const
 	{
 		const char* text = _parsed->_text._b;
+		if (_parsed->_tape_layout)
+		{
+			int32_t at = tape_child(i);
+			if (at < 0 || _value._t != e_object)
+				return TextSpan();
+
+			Value k = tape_value(*_parsed, at);
+			return { text + k._b, text + k._e };
+		}
+
 		Key k = _parsed->_object_kvps[_value._b + i]._k;
 		return { text + k._b, text + k._e };
 	}
 
 	Proxy Proxy::get_child(int i) const
 	{
+		if (_parsed->_tape_layout)
+		{
+			int32_t at = tape_child(i);
+			if (at < 0)
+				return Proxy({ e_null, -1,-1, 0 }, _parsed);
+
+			if (_value._t == e_object)
+				at = tape_next(*_parsed, at); // skip the key
+			return Proxy(tape_value(*_parsed, at), _parsed);
+		}
+
 		switch (_value._t)
 		{
 		case e_array:
@@ -934,10 +1837,6 @@ namespace OkJsonReader
 
 	bool Proxy::keys_same(const HashedKey& a, Key b) const
 	{
-		// hash
-		if (a._h != b._h)
-			return false;
-
 		// length
 		int b_len = b._e - b._b;
 		if (b_len != a._s)
@@ -956,20 +1855,39 @@ namespace OkJsonReader
 		return true;
 	}
 
+	// tape layout, the value of the first key that matches
+	template<typename Match>
+	int32_t find_tape_value(const Parsed& parsed, Value object, Match match)
+	{
+		for (int32_t at = object._b + 1; at < object._e; )
+		{
+			Value k = tape_value(parsed, at);
+			at = tape_next(parsed, at);
+			if (match(k))
+				return at;
+			at = tape_next(parsed, at);
+		}
+
+		return -1;
+	}
+
 	Proxy Proxy::get_child(HashedKey key) const
 	{
-		if (_value._t == e_object)
+		if (_value._t == e_object && _parsed->_tape_layout)
 		{
-			// compare all (hash-first)
-			int lim = _value._e;
-			for (int i = _value._b; i < lim; ++i)
+			const char* text = _parsed->_text._b;
+			int32_t at = find_tape_value(*_parsed, _value, [&](Value k)
 			{
-				const KvP& kvp = _parsed->_object_kvps[i];
-				if (keys_same(key, kvp._k))
-				{
-					return Proxy(kvp._v, _parsed);
-				}
-			}
+				return k._e - k._b == key._s && memcmp(text + k._b, key._b, key._s) == 0;
+			});
+			if (at >= 0)
+				return Proxy(tape_value(*_parsed, at), _parsed);
+		}
+		else if (_value._t == e_object)
+		{
+			int i = find_kvp(*_parsed, _value, key._h, [&](Key k) { return keys_same(key, k); });
+			if (i >= 0)
+				return Proxy(_parsed->_object_kvps[i]._v, _parsed);
 		}
 
 		// if issue return empty proxy
@@ -978,36 +1896,272 @@ namespace OkJsonReader
 
 	Proxy Proxy::get_child(HashedKeyStripped key) const
 	{
-		if (_value._t == e_object)
+		if (_value._t == e_object && _parsed->_tape_layout)
 		{
-			// compare all only hash+length
-			int lim = _value._e;
-			for (int i = _value._b; i < lim; ++i)
+			// no stored hash, only hashed when the length matches
+			const char* text = _parsed->_text._b;
+			int32_t at = find_tape_value(*_parsed, _value, [&](Value k)
 			{
-				const KvP& kvp = _parsed->_object_kvps[i];
-				const Key& k = kvp._k;
-				if (key._h != k._h)
-					continue;
+				return k._e - k._b == key._s && key_hash(text + k._b, key._s) == key._h;
+			});
+			if (at >= 0)
+				return Proxy(tape_value(*_parsed, at), _parsed);
+		}
+		else if (_value._t == e_object)
+		{
+			// compare only hash+length
+			int i = find_kvp(*_parsed, _value, key._h, [&](Key k) { return key._s == (k._e - k._b); });
+			if (i >= 0)
+				return Proxy(_parsed->_object_kvps[i]._v, _parsed);
+		}
+
+		// if issue return empty proxy
+		return Proxy({ e_null, -1,-1, 0 }, _parsed);
+	}
+
+
+
+
+
+	PaddedText::PaddedText()
+	{
+	}
+
+	PaddedText::PaddedText(const char* text, int size)
+	{
+		allocate(size);
+		memcpy(_data, text, size);
+	}
+
+	PaddedText::~PaddedText()
+	{
+		release();
+	}
+
+	PaddedText::PaddedText(PaddedText&& other)
+	{
+		*this = std::move(other);
+	}
+
+	PaddedText& PaddedText::operator=(PaddedText&& other)
+	{
+		if (this != &other)
+		{
+			release();
+			_data = other._data;
+			_size = other._size;
+			_mapped_size = other._mapped_size;
+			other._data = nullptr;
+			other._size = 0;
+			other._mapped_size = 0;
+		}
+		return *this;
+	}
+
+	void PaddedText::allocate(int size)
+	{
+		release();
+		_data = (char*)malloc((size_t)size + k_padding);
+		_size = size;
+		memset(_data + size, 0, k_padding);
+	}
+
+	void PaddedText::release()
+	{
+#if OK_JSON_MMAP
+		if (_mapped_size != 0)
+		{
+			munmap(_data, _mapped_size);
+			_data = nullptr;
+		}
+#endif
+		free(_data);
+		_data = nullptr;
+		_size = 0;
+		_mapped_size = 0;
+	}
+
+	void set_error(std::string* put_error_here, const char* desc, const char* path)
+	{
+		std::string error = desc;
+		error += path;
+
+		if (put_error_here != nullptr)
+			*put_error_here = error;
+		else
+			puts(error.c_str());
+	}
+
+	bool PaddedText::load_file(const char* path, std::string* put_error_here)
+	{
+		release();
+
+#if OK_JSON_MMAP
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+		{
+			set_error(put_error_here, "could not open: ", path);
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size > INT_MAX - k_padding)
+		{
+			close(fd);
+			set_error(put_error_here, "could not map (files are limited to 2 GB): ", path);
+			return false;
+		}
 
-				if (key._s != (k._e-k._b))
-					continue;
+		// reserve zeroed memory for text + padding, then map the file over the start of it
+		// (the rest of the last page of the file is zero too)
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t size = (size_t)st.st_size;
+		size_t mapped_size = (size + k_padding + page - 1) / page * page;
+
+		void* base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED)
+		{
+			close(fd);
+			set_error(put_error_here, "could not map: ", path);
+			return false;
+		}
 
-				return Proxy(kvp._v, _parsed);
+		if (size > 0)
+		{
+			void* text = mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+			if (text == MAP_FAILED)
+			{
+				munmap(base, mapped_size);
+				close(fd);
+				set_error(put_error_here, "could not map: ", path);
+				return false;
 			}
+
+			madvise(base, size, MADV_SEQUENTIAL);
 		}
 
-		// if issue return empty proxy
-		return Proxy({ e_null, -1,-1, 0 }, _parsed);
+		close(fd);
+
+		_data = (char*)base;
+		_size = (int)size;
+		_mapped_size = mapped_size;
+		return true;
+#else
+		FILE* f = fopen(path, "rb");
+		if (f == nullptr)
+		{
+			set_error(put_error_here, "could not open: ", path);
+			return false;
+		}
+
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		if (size < 0 || size > INT_MAX - k_padding)
+		{
+			fclose(f);
+			set_error(put_error_here, "could not read (files are limited to 2 GB): ", path);
+			return false;
+		}
+
+		allocate((int)size);
+		size_t read = fread(_data, 1, (size_t)size, f);
+		fclose(f);
+
+		if (read != (size_t)size)
+		{
+			release();
+			set_error(put_error_here, "could not read: ", path);
+			return false;
+		}
+
+		return true;
+#endif
+	}
+
+	bool parse_part(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, TextSpan part, Value& root, std::string* put_error_here, int64_t* allocations)
+	{
+		Parser parser;
+		parser.begin(&parsed, &scratch, options, false);
+		root = parser.parse_root(part, options);
+
+		if (allocations != nullptr)
+			*allocations += parser._allocations;
+
+		if (!parser._error)
+			return true;
+
+		root = { e_null, -1, -1, 0 };
+		if (put_error_here != nullptr)
+			*put_error_here = parser._error_description;
+
+		return false;
+	}
+
+	bool parse_part_elements(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, TextSpan part, bool last, std::vector<Value>& values, std::string* put_error_here, const std::vector<uint32_t>* index)
+	{
+		Parser parser;
+		parser.begin(&parsed, &scratch, options, false);
+		parser.parse_elements(part, options, last, values, index);
+
+		if (!parser._error)
+			return true;
+
+		if (put_error_here != nullptr)
+			*put_error_here = parser._error_description;
+
+		return false;
 	}
 
+	bool parse_step(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, ParseProgress& progress, int32_t stop, std::string* put_error_here, int64_t* allocations)
+	{
+		Parser parser;
+		if (!progress._started)
+		{
+			parser.begin(&parsed, &scratch, options, false);
+			parser.clear_nodes();
+			parsed._root = { e_null, -1, -1, 0 };
+		}
+		else
+		{
+			// the rest is where the last step left it, in parsed, scratch and progress
+			parser._dest = &parsed;
+			parser._scratch = &scratch;
+			parser._max_depth = options._max_depth;
+			parser._projection = options._projection;
+		}
 
+		parser.parse_step(progress, stop >= 0 ? parsed._text._b + stop : nullptr, options);
 
+		if (allocations != nullptr)
+			*allocations += parser._allocations;
 
+		if (!parser._error)
+			return true;
 
-	bool Reader::parse(const char* text, int text_length, std::string* put_error_here)
+		if (put_error_here != nullptr)
+			*put_error_here = parser._error_description;
+
+		return false;
+	}
+
+	Parsed::Parsed(std::pmr::memory_resource* resource)
+		: _array_values(resource)
+		, _object_kvps(resource)
+		, _key_hashes(resource)
+		, _tape(resource)
+		, _object_index_slots(resource)
+		, _object_indices(resource)
+	{
+	}
+
+	Reader::Reader(std::pmr::memory_resource* resource)
+		: _parsed(resource)
 	{
-		// if verbose, stats do timings
+	}
 
+	bool Reader::parse(const char* text, int text_length, std::string* put_error_here)
+	{
 		if (text_length < 0)
 		{
 			// calculate length if needed
@@ -1016,8 +2170,53 @@ namespace OkJsonReader
 				++text_length;
 		}
 
+		return parse_common({ text, text + text_length }, false, nullptr, put_error_here);
+	}
+
+	bool Reader::parse(const PaddedText& text, std::string* put_error_here)
+	{
+		return parse_common({ text.data(), text.data() + text.size() }, true, nullptr, put_error_here);
+	}
+
+	bool Reader::parse_in_situ(char* text, int text_length, std::string* put_error_here)
+	{
+		if (text_length < 0)
+			text_length = (int)strlen(text);
+
+		return parse_common({ text, text + text_length }, false, text, put_error_here);
+	}
+
+	bool Reader::parse_in_situ(PaddedText& text, std::string* put_error_here)
+	{
+		return parse_common({ text.data(), text.data() + text.size() }, true, text.data(), put_error_here);
+	}
+
+	bool Reader::parse_file(const char* path, std::string* put_error_here)
+	{
+		// the old tree may point into the old file
+		reset();
+
+		if (!_file.load_file(path, put_error_here))
+			return false;
+
+		return parse(_file, put_error_here);
+	}
+
+	bool Reader::parse_common(TextSpan text, bool padded, char* in_situ, std::string* put_error_here)
+	{
+#if OK_JSON_STATS
+		double seconds = stats_seconds();
+		uint64_t ticks = stats_ticks();
+#endif
+
 		Parser parser;
-		parser.parse({text, text + text_length}, &_parsed);
+		parser._in_situ = in_situ;
+		parser.parse(text, &_parsed, &_scratch, _options, padded);
+		_allocation_count += parser._allocations;
+
+#if OK_JSON_STATS
+		parser.end_stats(text, stats_ticks() - ticks, stats_seconds() - seconds, _stats);
+#endif
 
 		// check error
 		if (!parser._error)
@@ -1033,6 +2232,61 @@ namespace OkJsonReader
 		return false;
 	}
 
+	void Reader::set_options(const ParseOptions& options)
+	{
+		_options = options;
+	}
+
+	const ParseOptions& Reader::get_options() const
+	{
+		return _options;
+	}
+
+	void Reader::reset(bool release_memory)
+	{
+		_file.release();
+
+		_parsed._text = TextSpan();
+		_parsed._root = { e_null, -1, -1, 0 };
+
+		if (release_memory)
+		{
+			release_buffer(_parsed._array_values);
+			release_buffer(_parsed._object_kvps);
+			release_buffer(_parsed._key_hashes);
+			release_buffer(_parsed._tape);
+			release_buffer(_parsed._object_index_slots);
+			release_buffer(_parsed._object_indices);
+			release_buffer(_scratch._containers);
+			release_buffer(_scratch._array_stack);
+			release_buffer(_scratch._object_stack);
+			release_buffer(_scratch._key_hash_stack);
+			release_buffer(_scratch._structural_index);
+			return;
+		}
+
+		_parsed._array_values.clear();
+		_parsed._object_kvps.clear();
+		_parsed._key_hashes.clear();
+		_parsed._tape.clear();
+		_parsed._object_index_slots.clear();
+		_parsed._object_indices.clear();
+		_scratch._containers.clear();
+		_scratch._array_stack.clear();
+		_scratch._object_stack.clear();
+		_scratch._key_hash_stack.clear();
+	}
+
+	int64_t Reader::get_allocation_count() const
+	{
+		return _allocation_count;
+	}
+
+	const ParseStats& Reader::get_stats() const
+	{
+		return _stats;
+	}
+
 	Proxy Reader::get_root()
 	{
 		return Proxy(_parsed._root, &_parsed);
@@ -1090,21 +2344,25 @@ namespace OkJsonReader
 		break;
 
 		case e_int:
-			int inum;
+		{
+			int64_t inum = 0;
 			p.try_get(inum);
-			printf("[int] %d\n", inum);
-			break;
+			printf("[int] %lld\n", (long long)inum);
+		}
+		break;
 
 		case e_number:
-			double num;
+		{
+			double num = 0.0;
 			p.try_get(num);
 			printf("[number] %f\n", num);
-			break;
+		}
+		break;
 
 		case e_string:
 		{
-			TextSpan text = p.debug_get_as_raw_string();
-			std::string unescaped = Proxy::unescape(text);
+			std::string unescaped;
+			p.try_get(unescaped);
 			printf("[string] %s\n", unescaped.c_str());
 		}
 		break;
@@ -1,13 +1,44 @@
 #ifndef OK_JSON_READER_H
 #define OK_JSON_READER_H
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <memory_resource>
+
+// count what every parse does (Reader::get_stats), off by default
+// when off the counting is compiled out and the stats stay 0
+#ifndef OK_JSON_STATS
+#define OK_JSON_STATS 0
+#endif
 
 namespace OkJsonReader
 {
 	const uint64_t k_fnv1a_offset_basis = 0xcbf29ce484222325UL; // FNV-1a to speed up key-value access
+	const uint64_t k_fnv1a_mul = 0x00000100000001B3UL;
+
+	// usable at compile time, so keys from string literals can be hashed by the compiler
+	constexpr int32_t key_length(const char* text)
+	{
+		int32_t i = 0;
+		while (text[i] != 0)
+			++i;
+		return i;
+	}
+
+	constexpr uint64_t key_hash(const char* text, int32_t size)
+	{
+		uint64_t h = k_fnv1a_offset_basis;
+		for (int32_t i = 0; i < size; ++i)
+		{
+			int v = text[i];
+			h ^= v;
+			h *= k_fnv1a_mul;
+		}
+		return h;
+	}
 
 	enum Type
 	{
@@ -21,19 +52,23 @@ namespace OkJsonReader
 		e_null
 	};
 
-	struct Value
+	struct Key
 	{
-		Type _t;
-		int32_t _b;
+		int32_t _b; // string from text
 		int32_t _e;
-		double _number;
 	};
 
-	struct Key
+	struct Value
 	{
-		int32_t _b; // string from text
+		Type _t;
+		int32_t _b;
 		int32_t _e;
-		uint64_t _h;
+		union
+		{
+			double _number; // e_number
+			int64_t _int; // e_int
+			Key _source; // e_object and e_array (not on the tape), from the '{' or '[' to after its bracket
+		};
 	};
 
 	struct KvP
@@ -69,17 +104,130 @@ namespace OkJsonReader
 		}
 	};
 
+	// hash table for the keys of one wide object
+	struct ObjectIndex
+	{
+		int32_t _slots_begin; // into Parsed::_object_index_slots
+		uint32_t _mask; // number of slots - 1
+	};
+
+	// the nodes of a parsed tree come from the memory resource of the Parsed (the default heap unless
+	// one is given), so a tree can live in a per-request arena and be freed with the arena
 	struct Parsed
 	{
+		Parsed() = default;
+		explicit Parsed(std::pmr::memory_resource* resource);
+
 		TextSpan _text; // strings index into source-text
 		
 		// arrays
-		std::vector<Value> _array_values; // arrays index into here
+		std::pmr::vector<Value> _array_values; // arrays index into here
 
 		// objects
-		std::vector<KvP> _object_kvps; // objects index into here
+		std::pmr::vector<KvP> _object_kvps; // objects index into here
+		std::pmr::vector<uint64_t> _key_hashes; // hash of every key, parallel to _object_kvps (lookups only touch this)
+
+		// or everything in one tape (ParseOptions::_tape), 8-byte words in document order
+		// the type is in the top 8 bits, containers have the index after their last word and the count
+		// of children (an object's children are key, value, key, value...), strings, keys and the other
+		// scalars have the offset and length of their text, numbers have a second word with the value
+		bool _tape_layout = false;
+		std::pmr::vector<uint64_t> _tape;
 		
 		Value _root { e_null, -1, -1, 0 }; // null-value
+
+		bool _lazy_numbers = false; // numbers are converted from the text when read
+		bool _unescaped = false; // escape codes of strings (not keys) were applied in the text (Reader::parse_in_situ)
+
+		// objects with at least this many keys get a hash table on the first lookup by key
+		// (built from const lookups, so a parsed tree can not be shared between threads while looking up)
+		int _object_index_min_size = 32;
+		mutable std::pmr::vector<int32_t> _object_index_slots; // kvp index or -1
+		mutable std::pmr::unordered_map<int32_t, ObjectIndex> _object_indices; // by the first kvp of the object
+	};
+
+	// a container that is being parsed
+	struct OpenContainer
+	{
+		Type _t;
+		uint32_t _count; // children on the tape
+		size_t _stack_begin; // its first child on the scratch-stack
+		size_t _tape_at; // its word on the tape
+		int32_t _source_b; // its '{' or '[' in the text
+
+		// objects, the kvp being parsed (and the projection state to go back to after its value)
+		Key _key;
+		uint64_t _key_hash;
+		int32_t _projection_node;
+		bool _discard;
+		bool _keep;
+	};
+
+	// temporary storage used while parsing, kept by the reader so it can be reused
+	// (always on the heap, it outlives the trees parsed with it)
+	struct ParseScratch
+	{
+		std::vector<OpenContainer> _containers; // the parser does not recurse, open containers are kept here
+		std::vector<Value> _array_stack; // values of all currently open arrays
+		std::vector<KvP> _object_stack; // kvps of all currently open objects
+		std::vector<uint64_t> _key_hash_stack; // and the hashes of their keys
+		std::vector<uint32_t> _structural_index; // offsets of all tokens (two-stage parse)
+	};
+
+	// what one parse did, only counted when compiled with OK_JSON_STATS=1
+	struct ParseStats
+	{
+		int64_t _bytes = 0; // text parsed
+		int64_t _values = 0; // values stored (containers and the root too, not keys)
+		int64_t _kvps = 0;
+		int64_t _numbers = 0; // converted while parsing (not with lazy numbers)
+		int32_t _max_depth = 0; // deepest nesting of containers
+		int64_t _allocations = 0; // times a buffer had to grow (the parser allocates nothing else)
+		int64_t _bytes_allocated = 0; // size of the grown buffers
+
+		// the scan is stage 1 (structural index and utf-8 check), building the tree is all the rest
+		// the split is measured with a cycle counter where there is one (a clock read per number otherwise)
+		double _seconds_total = 0.0;
+		double _seconds_scan = 0.0;
+		double _seconds_numbers = 0.0;
+		double _seconds_tree = 0.0;
+	};
+
+	struct Projection;
+
+	struct ParseOptions
+	{
+		// two-stage parse, first find all tokens with simd then parse from token to token
+		// only used for texts of at least _structural_index_min_size bytes without comments
+		bool _structural_index = true;
+		int _structural_index_min_size = 4096;
+
+		// with a structural index, count its tokens first and reserve the nodes for them, so the
+		// tree does not grow (and copy) its buffers while parsing (not with a projection)
+		bool _presize = true;
+
+		// only check the syntax of numbers while parsing, convert them on the first try_get
+		// debug_get_type() is then only a hint (e_int if there is no fraction or exponent)
+		bool _lazy_numbers = false;
+
+		// fail on text that is not valid utf-8 (the error has the offset, line and col of the first bad byte)
+		// done while building the structural index, texts that do not get one have a pass of their own
+		bool _validate_utf8 = false;
+
+		// containers nested deeper than this fail the parse
+		// the parser does not recurse, this only limits hostile input (and code that walks the tree recursively)
+		int _max_depth = 1024;
+
+		// lookups by key in objects this wide use a hash table (smaller objects are searched linearly)
+		int _object_index_min_size = 32;
+
+		// only keep these paths (see Projection in ok_json_query.h), the rest is checked but not stored
+		// the projection is not copied and has to live until the parse is done
+		const Projection* _projection = nullptr;
+
+		// put the tree in the compact tape layout (about half the memory, children follow their parent)
+		// walking children in order is as fast, but lookups by key are always linear
+		bool _tape = false;
 	};
 
 	///////////////////////////////////////////////////////////////////////////////////////
@@ -87,6 +235,7 @@ namespace OkJsonReader
 	///////////////////////////////////////////////////////////////////////////////////////
 
 	// Maybe allow these to be created fron text-spans too (to embed all in one string)
+	// both are constexpr, "constexpr HashedKey k("timestamp");" is hashed at compile time
 	struct HashedKey
 	{
 		const char* _b = nullptr;
@@ -94,7 +243,12 @@ namespace OkJsonReader
 		int32_t _s = 0;
 
 		// key has to include escape codes (to match json-file)
-		HashedKey(const char* text);
+		constexpr HashedKey(const char* text)
+			: _b(text)
+			, _h(key_hash(text, key_length(text)))
+			, _s(key_length(text))
+		{
+		}
 	};
 
 	// same as above but forget about full text
@@ -104,9 +258,27 @@ namespace OkJsonReader
 		int32_t _s; // size
 
 		// key to include escape codes (to match json-file)
-		static HashedKeyStripped from_string(const char* text);
+		static constexpr HashedKeyStripped from_string(const char* text)
+		{
+			return { key_hash(text, key_length(text)), key_length(text) };
+		}
 	};
 
+#if defined(__cpp_consteval)
+#define OK_JSON_CONSTEVAL consteval
+#else
+#define OK_JSON_CONSTEVAL constexpr
+#endif
+
+	namespace Literals
+	{
+		// "timestamp"_okkey, always computed by the compiler when consteval is available (c++20)
+		OK_JSON_CONSTEVAL HashedKeyStripped operator""_okkey(const char* text, size_t size)
+		{
+			return { key_hash(text, (int32_t)size), (int32_t)size };
+		}
+	}
+
 	struct Reader;
 
 	// "proxy" objects, used on "parsed" data
@@ -115,14 +287,24 @@ namespace OkJsonReader
 		Type debug_get_type() const;
 		TextSpan debug_get_as_raw_string() const; // available for all types (not objects or arrays) "raw" means that escape codes are still in here
 
-		static std::string unescape(TextSpan text); // applies escape-codes
+		// the value as it is in the text (strings with their quotes, containers with all their text)
+		// empty for containers of the tape layout, and strings of parse_in_situ have lost their escape codes
+		TextSpan get_source() const;
+
+		// applies escape-codes (\u with surrogate pairs becomes utf-8, lone surrogates become U+FFFD)
+		// the result is never longer than text, dst needs that many bytes and may be text._b (in place)
+		// returns the size written or -1 for an invalid escape code
+		static int unescape(TextSpan text, char* dst);
+		static std::string unescape(TextSpan text); // empty for an invalid escape code
 
 		// simplest getters (returns valid)
-		bool try_get(TextSpan& v) const;
-		bool try_get(std::string& v) const;
+		bool try_get(TextSpan& v) const; // escape codes are still in here (unless parsed in situ)
+		bool try_get(std::string& v) const; // escape codes applied, reuses the capacity of v
 		bool try_get(bool& v) const;
 		bool try_get(int& v) const;
-		bool try_get(double& v) const;
+		bool try_get(int64_t& v) const; // exact, fails if not an integer that fits
+		bool try_get(uint64_t& v) const; // exact, fails if not an integer that fits
+		bool try_get(double& v) const; // correctly rounded
 		bool try_get(float& v) const;
 
 		int size() const; // valid for string, array and object only
@@ -133,30 +315,154 @@ namespace OkJsonReader
 
 	private:
 		Proxy(Value value, const Parsed* parsed);
-		bool keys_same(const HashedKey& a, Key b) const;
+		bool keys_same(const HashedKey& a, Key b) const; // the hashes are already known to match
+		void convert_lazy_number() const;
+		int32_t tape_child(int i) const;
 
-		Value _value;
+		mutable Value _value; // numbers of a lazy parse are converted in place
 		const Parsed* _parsed;
+		mutable bool _number_ready = true;
+
+		// tape layout, the last child found (children are found by walking, this makes walking in order cheap)
+		mutable int32_t _tape_i = -1;
+		mutable int32_t _tape_at = -1;
 
 		friend Reader;
+		friend struct LinesReader;
+		friend struct ParallelReader;
+		friend struct StreamReader;
+		friend struct Cursor;
+		friend struct Query;
+		friend struct Editor;
 	};
 
 	///////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////
 
+	enum
+	{
+		k_padding = 64 // zero bytes after the text of a PaddedText
+	};
+
+	// text that is followed by k_padding readable zero bytes, lets the parser skip most end checks
+	// either owns a copy (or a buffer for the caller to fill) or a memory mapped file
+	struct PaddedText
+	{
+		PaddedText();
+		PaddedText(const char* text, int size); // copy
+		~PaddedText();
+
+		PaddedText(PaddedText&& other);
+		PaddedText& operator=(PaddedText&& other);
+		PaddedText(const PaddedText&) = delete;
+		PaddedText& operator=(const PaddedText&) = delete;
+
+		// uninitialized text of size bytes (plus padding), for the caller to fill in
+		void allocate(int size);
+
+		// memory maps the file (copy-on-write) where supported, otherwise reads it
+		// files are limited to 2 GB since all offsets are 32 bit
+		bool load_file(const char* path, std::string* put_error_here = nullptr);
+
+		void release();
+
+		char* data() { return _data; }
+		const char* data() const { return _data; }
+		int size() const { return _size; }
+
+	private:
+		char* _data = nullptr;
+		int _size = 0;
+		size_t _mapped_size = 0; // 0 if allocated
+	};
+
 	// parser
 	struct Reader
 	{
+		Reader() = default;
+
+		// the parsed tree is allocated from resource (which has to outlive the reader), e.g. a
+		// std::pmr::monotonic_buffer_resource per request, reset(true) gives its buffers back to it
+		explicit Reader(std::pmr::memory_resource* resource);
+
+		// buffers keep their capacity between calls, parsing many small documents
+		// with the same reader does not allocate once the buffers are large enough
 		bool parse(const char* text, int text_length = -1, std::string* put_error_here = nullptr);
 
+		// faster, relies on the padding instead of checking for the end of the text
+		bool parse(const PaddedText& text, std::string* put_error_here = nullptr);
+
+		// the escape codes of strings are applied in the text while parsing, so strings are
+		// TextSpans with no copy (keys keep their escape codes so they still match HashedKey)
+		// the text is changed inside strings, even if the parse fails
+		bool parse_in_situ(char* text, int text_length = -1, std::string* put_error_here = nullptr);
+		bool parse_in_situ(PaddedText& text, std::string* put_error_here = nullptr);
+
+		// memory maps the file, the reader keeps the file until the next parse_file or reset
+		bool parse_file(const char* path, std::string* put_error_here = nullptr);
+
+		// binary snapshot of the parsed tree and its text, loading it needs no parse
+		// the file is mapped and the text is used in place, only the nodes are copied
+		// a snapshot is only loaded by the same version of this code on the same kind of machine,
+		// anything else (or a damaged file) fails the version and checksum checks
+		bool save_snapshot(const char* path, std::string* put_error_here = nullptr) const;
+		bool load_snapshot(const char* path, std::string* put_error_here = nullptr);
+
+		void set_options(const ParseOptions& options);
+		const ParseOptions& get_options() const;
+
+		// drop the parsed tree, optionally also free the buffers
+		void reset(bool release_memory = false);
+
+		// how many times a buffer had to grow (total over all parses)
+		int64_t get_allocation_count() const;
+
+		// the last parse, all 0 unless compiled with OK_JSON_STATS=1
+		const ParseStats& get_stats() const;
+
 		// warning, the proxy-objects will point to the submitted text above
 		Proxy get_root();
 
 	private:
+		bool parse_common(TextSpan text, bool padded, char* in_situ, std::string* put_error_here);
+
 		Parsed _parsed;
+		ParseScratch _scratch;
+		ParseOptions _options;
+		PaddedText _file;
+		int64_t _allocation_count = 0;
+		ParseStats _stats;
+	};
+
+	// used to parse parts of one text separately (in parallel)
+	// parses part (inside parsed._text) as one value and adds its nodes to the end of parsed
+	// on error root is null and the error (with line and col in the full text) is put in put_error_here
+	bool parse_part(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, TextSpan part, Value& root, std::string* put_error_here = nullptr, int64_t* allocations = nullptr);
+
+	// same as parse_part but part is a slice of the elements of an array (comma separated values)
+	// the values are added to the end of values, last allows a trailing comma or an empty slice
+	// index is the structural index of all of parsed._text (OkJsonScan::build_structural_index, with the utf-8
+	// checked if the options want it) when there is one, the slice has to end at one of its tokens
+	bool parse_part_elements(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, TextSpan part, bool last, std::vector<Value>& values, std::string* put_error_here = nullptr, const std::vector<uint32_t>* index = nullptr);
+
+	// where a parse in steps is, between the steps (the open containers are on the scratch)
+	struct ParseProgress
+	{
+		int32_t _read = 0; // offset the next step starts at
+		int32_t _projection_node = -1; // projection of the container on top
+		bool _discard = false;
+		bool _started = false; // the root container is open
 	};
 
+	// a parse of a text that is not all there yet (StreamReader), parsed._text is the text so far
+	// (it can move between steps, the nodes only have offsets)
+	// parses from progress up to stop, which has to be right after a '{', '[' or ',' of the root container
+	// (not in a string or comment), the containers are left open there
+	// stop -1 is the last step, the text is all of the document and parsed._root is set
+	// the parse is in one stage (no structural index) and not in situ
+	bool parse_step(Parsed& parsed, ParseScratch& scratch, const ParseOptions& options, ParseProgress& progress, int32_t stop, std::string* put_error_here = nullptr, int64_t* allocations = nullptr);
+
 	void debug_print_tree(const Proxy& p);
 };
 
@@ -0,0 +1,856 @@
+#include "ok_json_scan.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define OK_JSON_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define OK_JSON_X86 0
+#endif
+
+#if OK_JSON_X86 && (defined(__GNUC__) || defined(__clang__))
+#define OK_JSON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define OK_JSON_TARGET_AVX2
+#endif
+
+namespace OkJsonScan
+{
+	int count_trailing_zeros(uint64_t v)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long r;
+		_BitScanForward64(&r, v);
+		return (int)r;
+#else
+		return __builtin_ctzll(v);
+#endif
+	}
+
+	int count_ones(uint64_t v)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		return (int)__popcnt64(v);
+#else
+		return __builtin_popcountll(v);
+#endif
+	}
+
+	////////////////////////////////////////////////////////////////
+	// per isa block classification
+
+	void classify_block_scalar(const char* p, BlockMasks& masks)
+	{
+		masks = { 0, 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < k_block_size; ++i)
+		{
+			uint64_t bit = 1ULL << i;
+			switch (p[i])
+			{
+			case '\"': masks._quote |= bit; break;
+			case '\\': masks._backslash |= bit; break;
+			case '/': masks._slash |= bit; break;
+
+			case '{':
+			case '}':
+			case '[':
+			case ']':
+			case ':':
+			case ',':
+				masks._structural |= bit;
+				break;
+
+			case '\n':
+				masks._newline |= bit;
+				masks._ws |= bit;
+				break;
+
+			case ' ':
+			case '\t':
+			case '\r':
+			case '\f':
+				masks._ws |= bit;
+				break;
+
+			default:
+				if ((unsigned char)p[i] >= 0x80)
+					masks._non_ascii |= bit;
+				break;
+			}
+		}
+	}
+
+	int find_hash_scalar(const uint64_t* hashes, int count, uint64_t h)
+	{
+		int i = 0;
+		while (i < count && hashes[i] != h)
+			++i;
+		return i;
+	}
+
+	// utf-8 of whole blocks, what a block leaves for the next one
+	struct Utf8Blocks
+	{
+		unsigned char _prev[32] = {}; // the last 32 bytes
+		bool _prev_incomplete = false; // they end inside a sequence
+	};
+
+#if OK_JSON_X86
+	// 2 hashes per compare (sse2 has no 64-bit compare, both 32-bit halves have to match)
+	int find_hash_sse2(const uint64_t* hashes, int count, uint64_t h)
+	{
+		__m128i needle = _mm_set1_epi64x((long long)h);
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(hashes + i)), needle);
+			__m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(hashes + i + 2)), needle);
+			a = _mm_and_si128(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+			b = _mm_and_si128(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+
+			int bits = _mm_movemask_pd(_mm_castsi128_pd(a)) | (_mm_movemask_pd(_mm_castsi128_pd(b)) << 2);
+			if (bits != 0)
+				return i + count_trailing_zeros((uint64_t)bits);
+		}
+
+		return i + find_hash_scalar(hashes + i, count - i, h);
+	}
+
+	// 16 bits per call
+	uint64_t sse2_eq(__m128i v, char c)
+	{
+		return (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+	}
+
+	void classify_block_sse2(const char* p, BlockMasks& masks)
+	{
+		masks = { 0, 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 4; ++i)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(p + i * 16));
+			int shift = i * 16;
+
+			masks._quote |= sse2_eq(v, '\"') << shift;
+			masks._backslash |= sse2_eq(v, '\\') << shift;
+			masks._slash |= sse2_eq(v, '/') << shift;
+			masks._newline |= sse2_eq(v, '\n') << shift;
+			masks._non_ascii |= (uint64_t)(uint32_t)_mm_movemask_epi8(v) << shift;
+
+			uint64_t structural =
+				sse2_eq(v, '{') | sse2_eq(v, '}') |
+				sse2_eq(v, '[') | sse2_eq(v, ']') |
+				sse2_eq(v, ':') | sse2_eq(v, ',');
+			masks._structural |= structural << shift;
+
+			uint64_t ws =
+				sse2_eq(v, ' ') | sse2_eq(v, '\t') |
+				sse2_eq(v, '\n') | sse2_eq(v, '\r') |
+				sse2_eq(v, '\f');
+			masks._ws |= ws << shift;
+		}
+	}
+
+	// 32 bits per call
+	OK_JSON_TARGET_AVX2 uint64_t avx2_eq(__m256i v, char c)
+	{
+		return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+	}
+
+	OK_JSON_TARGET_AVX2 void classify_block_avx2(const char* p, BlockMasks& masks)
+	{
+		__m256i lo = _mm256_loadu_si256((const __m256i*)p);
+		__m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+
+		masks._quote = avx2_eq(lo, '\"') | (avx2_eq(hi, '\"') << 32);
+		masks._backslash = avx2_eq(lo, '\\') | (avx2_eq(hi, '\\') << 32);
+		masks._slash = avx2_eq(lo, '/') | (avx2_eq(hi, '/') << 32);
+		masks._newline = avx2_eq(lo, '\n') | (avx2_eq(hi, '\n') << 32);
+		masks._non_ascii = (uint64_t)(uint32_t)_mm256_movemask_epi8(lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+
+		// or the compares together before the movemask
+		__m256i s_lo = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(lo, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(lo, _mm256_set1_epi8('}'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(lo, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(lo, _mm256_set1_epi8(']'))));
+		s_lo = _mm256_or_si256(s_lo,
+			_mm256_or_si256(_mm256_cmpeq_epi8(lo, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(lo, _mm256_set1_epi8(','))));
+
+		__m256i s_hi = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(hi, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8('}'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(hi, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(']'))));
+		s_hi = _mm256_or_si256(s_hi,
+			_mm256_or_si256(_mm256_cmpeq_epi8(hi, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(','))));
+
+		masks._structural = (uint64_t)(uint32_t)_mm256_movemask_epi8(s_lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(s_hi) << 32);
+
+		// whitespace is ' ' or one of \t \n \f \r (9, 10, 12, 13)
+		__m256i w_lo = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(lo, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(lo, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(lo, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(lo, _mm256_set1_epi8('\r'))));
+		w_lo = _mm256_or_si256(w_lo, _mm256_cmpeq_epi8(lo, _mm256_set1_epi8('\f')));
+
+		__m256i w_hi = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(hi, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(hi, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(hi, _mm256_set1_epi8('\r'))));
+		w_hi = _mm256_or_si256(w_hi, _mm256_cmpeq_epi8(hi, _mm256_set1_epi8('\f')));
+
+		masks._ws = (uint64_t)(uint32_t)_mm256_movemask_epi8(w_lo) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(w_hi) << 32);
+	}
+
+	// 8 hashes per iteration
+	OK_JSON_TARGET_AVX2 int find_hash_avx2(const uint64_t* hashes, int count, uint64_t h)
+	{
+		__m256i needle = _mm256_set1_epi64x((long long)h);
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(hashes + i)), needle);
+			__m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(hashes + i + 4)), needle);
+
+			int bits = _mm256_movemask_pd(_mm256_castsi256_pd(a)) | (_mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4);
+			if (bits != 0)
+				return i + count_trailing_zeros((uint64_t)bits);
+		}
+
+		return i + find_hash_scalar(hashes + i, count - i, h);
+	}
+
+	// utf-8 with lookup tables (Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte")
+	// the high nibble of a byte, the low nibble of the byte before it and the high nibble of that byte
+	// each look up the errors the pair could have, the errors of the pair are what all three have
+	// the bits of the errors
+	enum
+	{
+		k_utf8_too_short = 1 << 0, // lead byte (or ascii) followed by a lead byte or ascii
+		k_utf8_too_long = 1 << 1, // ascii followed by a continuation byte
+		k_utf8_overlong_3 = 1 << 2, // e0 80..9f
+		k_utf8_too_large = 1 << 3, // f4 90..bf, f5..ff
+		k_utf8_surrogate = 1 << 4, // ed a0..bf
+		k_utf8_overlong_2 = 1 << 5, // c0, c1
+		k_utf8_too_large_1000 = 1 << 6, // f5..ff 80..8f
+		k_utf8_overlong_4 = 1 << 6, // f0 80..8f
+		k_utf8_two_conts = 1 << 7, // two continuation bytes (an error unless the sequence needs them)
+		k_utf8_carry = k_utf8_too_short | k_utf8_too_long | k_utf8_two_conts // errors that do not depend on the low nibble
+	};
+
+	alignas(16) const unsigned char k_utf8_byte_1_high[16] =
+	{
+		// 0___ ascii
+		k_utf8_too_long, k_utf8_too_long, k_utf8_too_long, k_utf8_too_long,
+		k_utf8_too_long, k_utf8_too_long, k_utf8_too_long, k_utf8_too_long,
+		// 10__ continuation
+		k_utf8_two_conts, k_utf8_two_conts, k_utf8_two_conts, k_utf8_two_conts,
+		// 1100, 1101 two byte lead
+		k_utf8_too_short | k_utf8_overlong_2,
+		k_utf8_too_short,
+		// 1110 three byte lead
+		k_utf8_too_short | k_utf8_overlong_3 | k_utf8_surrogate,
+		// 1111 four byte lead
+		k_utf8_too_short | k_utf8_too_large | k_utf8_too_large_1000 | k_utf8_overlong_4
+	};
+
+	alignas(16) const unsigned char k_utf8_byte_1_low[16] =
+	{
+		k_utf8_carry | k_utf8_overlong_3 | k_utf8_overlong_2 | k_utf8_overlong_4, // 0000
+		k_utf8_carry | k_utf8_overlong_2, // 0001
+		k_utf8_carry, // 0010
+		k_utf8_carry, // 0011
+		k_utf8_carry | k_utf8_too_large, // 0100
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000, // 0101
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000, // 1000
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000 | k_utf8_surrogate, // 1101
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000,
+		k_utf8_carry | k_utf8_too_large | k_utf8_too_large_1000
+	};
+
+	alignas(16) const unsigned char k_utf8_byte_2_high[16] =
+	{
+		// 0___ ascii
+		k_utf8_too_short, k_utf8_too_short, k_utf8_too_short, k_utf8_too_short,
+		k_utf8_too_short, k_utf8_too_short, k_utf8_too_short, k_utf8_too_short,
+		// 1000
+		k_utf8_too_long | k_utf8_overlong_2 | k_utf8_two_conts | k_utf8_overlong_3 | k_utf8_too_large_1000 | k_utf8_overlong_4,
+		// 1001
+		k_utf8_too_long | k_utf8_overlong_2 | k_utf8_two_conts | k_utf8_overlong_3 | k_utf8_too_large,
+		// 101_
+		k_utf8_too_long | k_utf8_overlong_2 | k_utf8_two_conts | k_utf8_surrogate | k_utf8_too_large,
+		k_utf8_too_long | k_utf8_overlong_2 | k_utf8_two_conts | k_utf8_surrogate | k_utf8_too_large,
+		// 11__ lead
+		k_utf8_too_short, k_utf8_too_short, k_utf8_too_short, k_utf8_too_short
+	};
+
+	// largest byte that can be at each place of the last 32 without a sequence going on after them
+	alignas(32) const unsigned char k_utf8_max_at_end[32] =
+	{
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+		0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf
+	};
+
+	// the 32 bytes that end n bytes before the end of v
+	template<int n>
+	OK_JSON_TARGET_AVX2 __m256i avx2_prev(__m256i v, __m256i prev)
+	{
+		return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(prev, v, 0x21), 16 - n);
+	}
+
+	OK_JSON_TARGET_AVX2 __m256i avx2_lookup(const unsigned char* table, __m256i nibbles)
+	{
+		return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)table)), nibbles);
+	}
+
+	OK_JSON_TARGET_AVX2 __m256i avx2_high_nibbles(__m256i v)
+	{
+		return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+	}
+
+	// non-zero bytes where v (that follows prev) is not utf-8
+	OK_JSON_TARGET_AVX2 __m256i utf8_errors_avx2(__m256i v, __m256i prev)
+	{
+		__m256i prev1 = avx2_prev<1>(v, prev);
+		__m256i errors = _mm256_and_si256(
+			_mm256_and_si256(
+				avx2_lookup(k_utf8_byte_1_high, avx2_high_nibbles(prev1)),
+				avx2_lookup(k_utf8_byte_1_low, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+			avx2_lookup(k_utf8_byte_2_high, avx2_high_nibbles(v)));
+
+		// the third and fourth byte of a sequence have to be continuation bytes (two_conts is what they need)
+		__m256i third = _mm256_subs_epu8(avx2_prev<2>(v, prev), _mm256_set1_epi8((char)(0xe0 - 0x80)));
+		__m256i fourth = _mm256_subs_epu8(avx2_prev<3>(v, prev), _mm256_set1_epi8((char)(0xf0 - 0x80)));
+		__m256i needed = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+		return _mm256_xor_si256(errors, needed);
+	}
+
+	// a block of 64 bytes, false if it has an error (or the block before ends a sequence too soon)
+	OK_JSON_TARGET_AVX2 bool check_utf8_block_avx2(const char* p, Utf8Blocks& state)
+	{
+		__m256i lo = _mm256_loadu_si256((const __m256i*)p);
+		__m256i hi = _mm256_loadu_si256((const __m256i*)(p + 32));
+
+		bool valid;
+		if (_mm256_movemask_epi8(_mm256_or_si256(lo, hi)) == 0)
+		{
+			valid = !state._prev_incomplete;
+		}
+		else
+		{
+			__m256i prev = _mm256_loadu_si256((const __m256i*)state._prev);
+			__m256i errors = _mm256_or_si256(utf8_errors_avx2(lo, prev), utf8_errors_avx2(hi, lo));
+			valid = _mm256_testz_si256(errors, errors) != 0;
+		}
+
+		__m256i incomplete = _mm256_subs_epu8(hi, _mm256_load_si256((const __m256i*)k_utf8_max_at_end));
+		state._prev_incomplete = _mm256_testz_si256(incomplete, incomplete) == 0;
+		_mm256_storeu_si256((__m256i*)state._prev, hi);
+		return valid;
+	}
+
+	bool cpu_has_avx2()
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		__cpuid(info, 1);
+		bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; // osxsave + ymm state
+		if (!os_saves_ymm)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif // OK_JSON_X86
+
+	////////////////////////////////////////////////////////////////
+	// dispatch
+
+	typedef void (*ClassifyFunction)(const char* p, BlockMasks& masks);
+
+	Isa detect_isa()
+	{
+#if OK_JSON_X86
+		if (cpu_has_avx2())
+			return e_avx2;
+		return e_sse2;
+#else
+		return e_scalar;
+#endif
+	}
+
+	ClassifyFunction classify_function_for(Isa isa)
+	{
+		switch (isa)
+		{
+#if OK_JSON_X86
+		case e_avx2: return classify_block_avx2;
+		case e_sse2: return classify_block_sse2;
+#endif
+		default: break;
+		}
+		return classify_block_scalar;
+	}
+
+	typedef bool (*Utf8BlockFunction)(const char* p, Utf8Blocks& state);
+
+	// null if the blocks are checked byte by byte
+	Utf8BlockFunction utf8_block_function_for(Isa isa)
+	{
+#if OK_JSON_X86
+		if (isa == e_avx2)
+			return check_utf8_block_avx2;
+#else
+		(void)isa;
+#endif
+		return nullptr;
+	}
+
+	typedef int (*FindHashFunction)(const uint64_t* hashes, int count, uint64_t h);
+
+	FindHashFunction find_hash_function_for(Isa isa)
+	{
+		switch (isa)
+		{
+#if OK_JSON_X86
+		case e_avx2: return find_hash_avx2;
+		case e_sse2: return find_hash_sse2;
+#endif
+		default: break;
+		}
+		return find_hash_scalar;
+	}
+
+	Isa g_isa = detect_isa();
+	ClassifyFunction g_classify = classify_function_for(g_isa);
+	FindHashFunction g_find_hash = find_hash_function_for(g_isa);
+	Utf8BlockFunction g_utf8_block = utf8_block_function_for(g_isa);
+
+	Isa get_isa()
+	{
+		return g_isa;
+	}
+
+	void set_isa(Isa isa)
+	{
+		// never go above what the cpu can do
+		if (isa > detect_isa())
+			isa = detect_isa();
+
+		g_isa = isa;
+		g_classify = classify_function_for(isa);
+		g_find_hash = find_hash_function_for(isa);
+		g_utf8_block = utf8_block_function_for(isa);
+	}
+
+	void classify_block(const char* p, BlockMasks& masks)
+	{
+		g_classify(p, masks);
+	}
+
+	int find_hash(const uint64_t* hashes, int count, uint64_t h)
+	{
+		return g_find_hash(hashes, count, h);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// strings
+
+	uint64_t find_escaped(uint64_t backslash, uint64_t& prev_escaped)
+	{
+		// a backslash that is itself escaped does not escape anything
+		backslash &= ~prev_escaped;
+
+		uint64_t follows_escape = (backslash << 1) | prev_escaped;
+
+		// odd-length runs of backslashes escape the byte after the run
+		const uint64_t k_even_bits = 0x5555555555555555ULL;
+		uint64_t odd_sequence_starts = backslash & ~k_even_bits & ~follows_escape;
+
+		uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+		prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts ? 1 : 0; // carry out
+
+		uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+		return (k_even_bits ^ invert_mask) & follows_escape;
+	}
+
+	uint64_t prefix_xor(uint64_t bits)
+	{
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+	}
+
+	void resolve_strings(const BlockMasks& masks, StringState& state, StringMasks& strings)
+	{
+		uint64_t escaped = find_escaped(masks._backslash, state._prev_escaped);
+		strings._quote = masks._quote & ~escaped;
+		strings._in_string = prefix_xor(strings._quote) ^ state._prev_in_string;
+		state._prev_in_string = (uint64_t)((int64_t)strings._in_string >> 63);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// utf-8
+
+	int32_t check_utf8(const char* p, int32_t i, int32_t size, Utf8State& state)
+	{
+		for (; i < size; ++i)
+		{
+			uint32_t c = (unsigned char)p[i];
+			if (state._needed != 0)
+			{
+				if (c < state._lo || c > state._hi)
+					return i;
+
+				state._lo = 0x80;
+				state._hi = 0xbf;
+				--state._needed;
+				continue;
+			}
+
+			if (c < 0x80)
+				continue;
+
+			// c0 and c1 could only start overlong forms
+			if (c < 0xc2)
+				return i;
+
+			if (c < 0xe0)
+			{
+				state._needed = 1;
+			}
+			else if (c < 0xf0)
+			{
+				state._needed = 2;
+				state._lo = c == 0xe0 ? 0xa0 : 0x80;
+				state._hi = c == 0xed ? 0x9f : 0xbf; // no surrogates
+			}
+			else if (c < 0xf5)
+			{
+				state._needed = 3;
+				state._lo = c == 0xf0 ? 0x90 : 0x80;
+				state._hi = c == 0xf4 ? 0x8f : 0xbf; // nothing above U+10FFFF
+			}
+			else
+			{
+				return i;
+			}
+		}
+
+		return -1;
+	}
+
+	int32_t find_invalid_utf8(const char* b, const char* e)
+	{
+		const uint64_t k_high_bits = 0x8080808080808080ULL;
+
+		Utf8State state;
+		int32_t size = (int32_t)(e - b);
+		int32_t i = 0;
+		while (i < size)
+		{
+			int32_t next = size - i >= 8 ? i + 8 : size;
+
+			// 8 ascii bytes at a time
+			if (state._needed == 0 && next - i == 8)
+			{
+				uint64_t word;
+				memcpy(&word, b + i, 8);
+				if ((word & k_high_bits) == 0)
+				{
+					i = next;
+					continue;
+				}
+			}
+
+			int32_t invalid = check_utf8(b, i, next, state);
+			if (invalid >= 0)
+				return invalid;
+
+			i = next;
+		}
+
+		return state._needed != 0 ? size : -1;
+	}
+
+	// the first invalid byte of the block at offset block of b, the blocks before it are valid
+	// -1 if it only has a sequence that is cut off by the end
+	int32_t find_invalid_utf8_in_block(const char* b, int32_t block, int32_t size)
+	{
+		// from the start of the last sequence that began before the block
+		int32_t i = block;
+		for (int32_t back = 1; back <= 3 && block - back >= 0; ++back)
+		{
+			if (((unsigned char)b[block - back] & 0xc0) != 0x80)
+			{
+				i = block - back;
+				break;
+			}
+		}
+
+		Utf8State state;
+		int32_t end = size - block >= k_block_size ? block + k_block_size : size;
+		return check_utf8(b, i, end, state);
+	}
+
+	////////////////////////////////////////////////////////////////
+	// structural index
+
+	// calls f(block offset, bytes of the block, masks) for every block, the last one padded with spaces
+	template<typename F>
+	void for_each_block(const char* b, const char* e, F f)
+	{
+		uint64_t size = (uint64_t)(e - b);
+		for (uint64_t block = 0; block < size; block += k_block_size)
+		{
+			BlockMasks masks;
+			if (size - block >= k_block_size)
+			{
+				classify_block(b + block, masks);
+				if (!f(block, b + block, masks))
+					return;
+			}
+			else
+			{
+				char tail[k_block_size];
+				memset(tail, ' ', k_block_size);
+				memcpy(tail, b + block, (size_t)(size - block));
+				classify_block(tail, masks);
+				if (!f(block, tail, masks))
+					return;
+			}
+		}
+	}
+
+	void append_offsets(uint64_t block, uint64_t bits, std::vector<uint32_t>& dst)
+	{
+		size_t at = dst.size();
+		dst.resize(at + count_ones(bits));
+		uint32_t* p = dst.data() + at;
+		for (; bits != 0; bits &= bits - 1)
+		{
+			*p++ = (uint32_t)(block + count_trailing_zeros(bits));
+		}
+	}
+
+	////////////////////////////////////////////////////////////////
+	// skipping
+
+	// byte by byte, for the tail and for blocks with comments
+	const char* skip_container_scalar(const char* p, const char* e, int depth, bool in_string, bool escaped)
+	{
+		for (; p < e; ++p)
+		{
+			char c = *p;
+			if (in_string)
+			{
+				if (escaped)
+					escaped = false;
+				else if (c == '\\')
+					escaped = true;
+				else if (c == '"')
+					in_string = false;
+				continue;
+			}
+
+			switch (c)
+			{
+			case '"':
+				in_string = true;
+				break;
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0)
+					return p + 1;
+				break;
+			case '/':
+				// comment until the end of the line
+				if (p + 1 < e && p[1] == '/')
+				{
+					while (p + 1 < e && p[1] != '\n')
+						++p;
+				}
+				break;
+			}
+		}
+
+		return nullptr;
+	}
+
+	const char* skip_container(const char* p, const char* e)
+	{
+		int depth = 0;
+		StringState state;
+		for (; e - p >= k_block_size; p += k_block_size)
+		{
+			BlockMasks masks;
+			classify_block(p, masks);
+
+			StringState block_start = state;
+			StringMasks strings;
+			resolve_strings(masks, state, strings);
+
+			uint64_t outside = ~strings._in_string;
+			if ((masks._slash & outside) != 0)
+				return skip_container_scalar(p, e, depth, block_start._prev_in_string != 0, block_start._prev_escaped != 0);
+
+			for (uint64_t bits = masks._structural & outside; bits != 0; bits &= bits - 1)
+			{
+				const char* at = p + count_trailing_zeros(bits);
+				if (*at == '{' || *at == '[')
+				{
+					++depth;
+				}
+				else if (*at == '}' || *at == ']')
+				{
+					if (--depth == 0)
+						return at + 1;
+				}
+			}
+		}
+
+		return skip_container_scalar(p, e, depth, state._prev_in_string != 0, state._prev_escaped != 0);
+	}
+
+	void find_newlines(const char* b, const char* e, std::vector<uint32_t>& newlines)
+	{
+		newlines.clear();
+
+		StringState state;
+		for_each_block(b, e, [&](uint64_t block, const char*, const BlockMasks& masks)
+		{
+			StringMasks strings;
+			resolve_strings(masks, state, strings);
+			append_offsets(block, masks._newline & ~strings._in_string, newlines);
+			return true;
+		});
+	}
+
+	bool build_structural_index(const char* b, const char* e, std::vector<uint32_t>& index, int32_t* invalid_utf8)
+	{
+		index.clear();
+
+		StringState state;
+		bool usable = true;
+
+		Utf8State utf8;
+		Utf8Blocks utf8_blocks;
+		bool check = invalid_utf8 != nullptr;
+		if (check)
+			*invalid_utf8 = -1;
+
+		int32_t size = (int32_t)(e - b);
+		for_each_block(b, e, [&](uint64_t block, const char* p, const BlockMasks& masks)
+		{
+			// whole blocks with avx2, only one with an error is looked at byte by byte (for the offset)
+			if (check && g_utf8_block != nullptr)
+			{
+				if (!g_utf8_block(p, utf8_blocks))
+				{
+					int32_t invalid = find_invalid_utf8_in_block(b, (int32_t)block, size);
+					*invalid_utf8 = invalid >= 0 ? invalid : size;
+					check = false;
+				}
+			}
+			// ascii blocks only have to check that no sequence is still open
+			else if (check && (masks._non_ascii != 0 || utf8._needed != 0))
+			{
+				int32_t first = (int32_t)block;
+				if (utf8._needed == 0)
+					first += count_trailing_zeros(masks._non_ascii);
+
+				int32_t end = size - (int32_t)block >= k_block_size ? (int32_t)block + k_block_size : size;
+				int32_t invalid = check_utf8(b, first, end, utf8);
+				if (invalid >= 0)
+				{
+					*invalid_utf8 = invalid;
+					check = false;
+				}
+			}
+
+			StringMasks strings;
+			resolve_strings(masks, state, strings);
+
+			uint64_t outside = ~strings._in_string;
+
+			// comments are only supported by the one-stage parse
+			if ((masks._slash & outside) != 0)
+			{
+				usable = false;
+				return false;
+			}
+
+			// numbers and literals are found by where they start
+			uint64_t scalar = ~(masks._structural | masks._ws | strings._quote) & outside;
+			uint64_t scalar_start = scalar & ~((scalar << 1) | state._prev_scalar);
+			state._prev_scalar = scalar >> 63;
+
+			append_offsets(block, (masks._structural & outside) | strings._quote | scalar_start, index);
+			return true;
+		});
+
+		index.push_back((uint32_t)(e - b)); // end marker
+
+		if (check && utf8._needed != 0)
+			*invalid_utf8 = size;
+
+		// the last block ends inside a sequence, or with a byte that can not start one
+		if (check && utf8_blocks._prev_incomplete)
+		{
+			int32_t invalid = find_invalid_utf8_in_block(b, (size - 1) / k_block_size * k_block_size, size);
+			*invalid_utf8 = invalid >= 0 ? invalid : size;
+		}
+
+		return usable;
+	}
+
+	void count_tokens(const char* b, const std::vector<uint32_t>& index, TokenCounts& counts)
+	{
+		size_t size = index.empty() ? 0 : index.size() - 1;
+		count_tokens(b, index.data(), index.data() + size, counts);
+	}
+
+	void count_tokens(const char* b, const uint32_t* first, const uint32_t* last, TokenCounts& counts)
+	{
+		// compares instead of a table of counters, so runs of the same token do not wait on each other
+		int64_t arrays = 0, objects = 0, commas = 0, colons = 0, quotes = 0, closing = 0;
+		size_t size = (size_t)(last - first);
+		for (size_t i = 0; i < size; ++i)
+		{
+			char c = b[first[i]];
+			arrays += c == '[';
+			objects += c == '{';
+			commas += c == ',';
+			colons += c == ':';
+			quotes += c == '"';
+			closing += (c == ']') | (c == '}');
+		}
+
+		counts._arrays = arrays;
+		counts._objects = objects;
+		counts._commas = commas;
+		counts._colons = colons;
+		counts._quotes = quotes;
+		counts._scalars = (int64_t)size - arrays - objects - commas - colons - quotes - closing;
+	}
+}
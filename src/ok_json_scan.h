@@ -0,0 +1,116 @@
+#ifndef OK_JSON_SCAN_H
+#define OK_JSON_SCAN_H
+
+#include <cstdint>
+#include <vector>
+
+// internal, simd helpers shared by the reader (not needed by users of the library)
+namespace OkJsonScan
+{
+	enum
+	{
+		k_block_size = 64 // one bit per byte in a uint64_t
+	};
+
+	enum Isa
+	{
+		e_scalar,
+		e_sse2,
+		e_avx2
+	};
+
+	// bit i is set if byte i of the block matches
+	struct BlockMasks
+	{
+		uint64_t _quote;
+		uint64_t _backslash;
+		uint64_t _structural; // { } [ ] : ,
+		uint64_t _ws;
+		uint64_t _slash; // start of a comment
+		uint64_t _newline;
+		uint64_t _non_ascii; // bytes >= 0x80 (utf-8 sequences)
+	};
+
+	// picked at startup from what the cpu supports, can be forced lower (for testing)
+	Isa get_isa();
+	void set_isa(Isa isa);
+
+	// p needs k_block_size readable bytes
+	void classify_block(const char* p, BlockMasks& masks);
+
+	// index of the first hash in hashes[0, count) that is h, count if there is none
+	int find_hash(const uint64_t* hashes, int count, uint64_t h);
+
+	// state carried from one block to the next
+	struct StringState
+	{
+		uint64_t _prev_escaped = 0; // 1 if the first byte of the next block is escaped
+		uint64_t _prev_in_string = 0; // all ones if the previous block ended inside a string
+		uint64_t _prev_scalar = 0; // 1 if the previous block ended inside a number/literal
+	};
+
+	// mask of the bytes that are escaped by a backslash
+	uint64_t find_escaped(uint64_t backslash, uint64_t& prev_escaped);
+
+	// bit i is the xor of bits 0..i
+	uint64_t prefix_xor(uint64_t bits);
+
+	// masks of one block with strings resolved
+	struct StringMasks
+	{
+		uint64_t _quote; // quotes that start or end a string
+		uint64_t _in_string; // inside a string, includes the opening quote but not the closing quote
+	};
+
+	void resolve_strings(const BlockMasks& masks, StringState& state, StringMasks& strings);
+
+	// utf-8 sequence carried from one block to the next
+	struct Utf8State
+	{
+		int32_t _needed = 0; // continuation bytes still to come
+		uint32_t _lo = 0x80; // range of the next continuation byte (rules out overlong forms and surrogates)
+		uint32_t _hi = 0xbf;
+	};
+
+	// checks bytes [i, size) of p, returns the index of the first invalid byte or -1
+	int32_t check_utf8(const char* p, int32_t i, int32_t size, Utf8State& state);
+
+	// offset of the first invalid utf-8 byte in [b, e) (e - b for a sequence cut off by the end), -1 if valid
+	int32_t find_invalid_utf8(const char* b, const char* e);
+
+	// stage 1 of a two-stage parse
+	// fill index with the offset of every structural character, every string quote and
+	// the start of every other token, followed by (e - b) as an end marker
+	// returns false if the text contains comments (the index can not be used then)
+	// if invalid_utf8 is set the text is also checked to be utf-8 in the same pass (with avx2 a block at a time
+	// with lookup tables, otherwise only blocks with bytes >= 0x80 are looked at byte by byte),
+	// it gets the offset like find_invalid_utf8
+	bool build_structural_index(const char* b, const char* e, std::vector<uint32_t>& index, int32_t* invalid_utf8 = nullptr);
+
+	// what the tokens of a structural index are, used to size the nodes before parsing
+	struct TokenCounts
+	{
+		int64_t _arrays = 0; // '['
+		int64_t _objects = 0; // '{'
+		int64_t _commas = 0;
+		int64_t _colons = 0;
+		int64_t _quotes = 0; // two per string or key
+		int64_t _scalars = 0; // numbers, true, false and null
+	};
+
+	// index as filled by build_structural_index (with the end marker)
+	void count_tokens(const char* b, const std::vector<uint32_t>& index, TokenCounts& counts);
+
+	// the tokens [first, last) of an index (offsets from b, no end marker)
+	void count_tokens(const char* b, const uint32_t* first, const uint32_t* last, TokenCounts& counts);
+
+	// p is at '{' or '[', returns the end of that container (after the matching bracket)
+	// only brackets are counted (strings and comments are skipped), the content is not validated
+	// nullptr if the text ends before the container does
+	const char* skip_container(const char* p, const char* e);
+
+	// offsets of all '\n' that are not inside a string (json lines)
+	void find_newlines(const char* b, const char* e, std::vector<uint32_t>& newlines);
+}
+
+#endif // OK_JSON_SCAN_H
@@ -0,0 +1,236 @@
+#include "ok_json_reader.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace OkJsonSnapshot_Private
+{
+	using namespace OkJsonReader;
+
+	enum
+	{
+		k_version = 3, // bump when Parsed or the file layout changes (2: containers have their _source, 3: checksum of the header)
+		k_endian_check = 0x01020304,
+		k_flag_lazy_numbers = 1,
+		k_flag_tape = 2,
+		k_flag_unescaped = 4
+	};
+
+	const char k_magic[8] = { 'o', 'k', 'j', 's', 'n', 'a', 'p', 0 };
+
+	// followed by the sections (text, array values, kvps, key hashes, tape), each padded to 8 bytes
+	struct Header
+	{
+		char _magic[8];
+		uint32_t _version;
+		uint32_t _endian;
+		uint32_t _value_size; // sizeof(Value), sizeof(KvP), to catch other compilers and platforms
+		uint32_t _kvp_size;
+		uint32_t _flags;
+		int32_t _object_index_min_size;
+		Value _root;
+		uint64_t _text_size;
+		uint64_t _array_count;
+		uint64_t _kvp_count;
+		uint64_t _tape_count;
+		uint64_t _checksum; // of the header (with this 0) and the padded sections
+	};
+
+	uint64_t padded_size(uint64_t size)
+	{
+		return (size + 7) & ~(uint64_t)7;
+	}
+
+	// FNV-1a style, 8 bytes per step
+	uint64_t checksum(uint64_t h, const void* data, uint64_t size)
+	{
+		const char* p = (const char*)data;
+		for (; size >= 8; size -= 8, p += 8)
+		{
+			uint64_t v;
+			memcpy(&v, p, 8);
+			h = (h ^ v) * k_fnv1a_mul;
+		}
+
+		for (; size > 0; --size, ++p)
+			h = (h ^ (uint8_t)*p) * k_fnv1a_mul;
+
+		return h;
+	}
+
+	// a section as it is in the file, padded with zeros to whole words
+	uint64_t checksum_padded(uint64_t h, const void* data, uint64_t size)
+	{
+		uint64_t words = size & ~(uint64_t)7;
+		h = checksum(h, data, words);
+		if (words == size)
+			return h;
+
+		char tail[8] = {};
+		memcpy(tail, (const char*)data + words, (size_t)(size - words));
+		return checksum(h, tail, 8);
+	}
+
+	// where the checksum starts
+	uint64_t checksum_header(Header header)
+	{
+		header._checksum = 0;
+		return checksum(k_fnv1a_offset_basis, &header, sizeof(header));
+	}
+
+	void snapshot_error(std::string* put_error_here, const char* desc, const char* path)
+	{
+		std::string error = desc;
+		error += path;
+
+		if (put_error_here != nullptr)
+			*put_error_here = error;
+		else
+			puts(error.c_str());
+	}
+
+	struct Section
+	{
+		const void* _data;
+		uint64_t _size;
+	};
+}
+
+namespace OkJsonReader
+{
+	using namespace OkJsonSnapshot_Private;
+
+	bool Reader::save_snapshot(const char* path, std::string* put_error_here) const
+	{
+		const Parsed& p = _parsed;
+
+		Header header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header._magic, k_magic, sizeof(k_magic));
+		header._version = k_version;
+		header._endian = k_endian_check;
+		header._value_size = sizeof(Value);
+		header._kvp_size = sizeof(KvP);
+		header._flags = (p._lazy_numbers ? k_flag_lazy_numbers : 0) | (p._tape_layout ? k_flag_tape : 0) | (p._unescaped ? k_flag_unescaped : 0);
+		header._object_index_min_size = p._object_index_min_size;
+		header._root = p._root;
+		header._text_size = (uint64_t)(p._text._e - p._text._b);
+		header._array_count = p._array_values.size();
+		header._kvp_count = p._object_kvps.size();
+		header._tape_count = p._tape.size();
+
+		const Section sections[] =
+		{
+			{ p._text._b, header._text_size },
+			{ p._array_values.data(), p._array_values.size() * sizeof(Value) },
+			{ p._object_kvps.data(), p._object_kvps.size() * sizeof(KvP) },
+			{ p._key_hashes.data(), p._key_hashes.size() * sizeof(uint64_t) },
+			{ p._tape.data(), p._tape.size() * sizeof(uint64_t) },
+		};
+
+		uint64_t h = checksum_header(header);
+		for (const Section& section : sections)
+			h = checksum_padded(h, section._data, section._size);
+		header._checksum = h;
+
+		const char zeros[8] = {};
+
+		FILE* f = fopen(path, "wb");
+		if (f == nullptr)
+		{
+			snapshot_error(put_error_here, "could not create: ", path);
+			return false;
+		}
+
+		bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+		for (const Section& section : sections)
+		{
+			size_t padding = (size_t)(padded_size(section._size) - section._size);
+			if (section._size > 0)
+				ok = ok && fwrite(section._data, (size_t)section._size, 1, f) == 1;
+			if (padding > 0)
+				ok = ok && fwrite(zeros, padding, 1, f) == 1;
+		}
+
+		ok = fclose(f) == 0 && ok;
+		if (!ok)
+		{
+			remove(path);
+			snapshot_error(put_error_here, "could not write: ", path);
+		}
+
+		return ok;
+	}
+
+	bool Reader::load_snapshot(const char* path, std::string* put_error_here)
+	{
+		reset();
+
+		if (!_file.load_file(path, put_error_here))
+			return false;
+
+		const char* data = _file.data();
+		uint64_t size = (uint64_t)_file.size();
+
+		Header header;
+		if (size < sizeof(header))
+		{
+			reset();
+			snapshot_error(put_error_here, "not a snapshot: ", path);
+			return false;
+		}
+
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header._magic, k_magic, sizeof(k_magic)) != 0)
+		{
+			reset();
+			snapshot_error(put_error_here, "not a snapshot: ", path);
+			return false;
+		}
+
+		if (header._version != k_version || header._endian != k_endian_check ||
+			header._value_size != sizeof(Value) || header._kvp_size != sizeof(KvP))
+		{
+			reset();
+			snapshot_error(put_error_here, "snapshot from another version: ", path);
+			return false;
+		}
+
+		uint64_t text_at = sizeof(header);
+		uint64_t arrays_at = text_at + padded_size(header._text_size);
+		uint64_t kvps_at = arrays_at + padded_size(header._array_count * sizeof(Value));
+		uint64_t hashes_at = kvps_at + padded_size(header._kvp_count * sizeof(KvP));
+		uint64_t tape_at = hashes_at + padded_size(header._kvp_count * sizeof(uint64_t));
+		uint64_t end = tape_at + padded_size(header._tape_count * sizeof(uint64_t));
+
+		// the sections are padded in the file, so this is the same words as checksum_padded of each
+		if (end != size || checksum(checksum_header(header), data + text_at, size - text_at) != header._checksum)
+		{
+			reset();
+			snapshot_error(put_error_here, "damaged snapshot: ", path);
+			return false;
+		}
+
+		// the text stays in the mapped file, the nodes are copied out of it
+		_parsed._text = TextSpan(data + text_at, data + text_at + header._text_size);
+
+		const Value* arrays = (const Value*)(data + arrays_at);
+		_parsed._array_values.assign(arrays, arrays + header._array_count);
+
+		const KvP* kvps = (const KvP*)(data + kvps_at);
+		_parsed._object_kvps.assign(kvps, kvps + header._kvp_count);
+
+		const uint64_t* hashes = (const uint64_t*)(data + hashes_at);
+		_parsed._key_hashes.assign(hashes, hashes + header._kvp_count);
+
+		const uint64_t* tape = (const uint64_t*)(data + tape_at);
+		_parsed._tape.assign(tape, tape + header._tape_count);
+
+		_parsed._root = header._root;
+		_parsed._lazy_numbers = (header._flags & k_flag_lazy_numbers) != 0;
+		_parsed._tape_layout = (header._flags & k_flag_tape) != 0;
+		_parsed._unescaped = (header._flags & k_flag_unescaped) != 0;
+		_parsed._object_index_min_size = header._object_index_min_size;
+		return true;
+	}
+};
@@ -0,0 +1,256 @@
+#include "ok_json_stream.h"
+
+#include <cstdio>
+
+namespace OkJsonReader
+{
+	StreamReader::Status StreamReader::feed(const char* chunk, int size, std::string* put_error_here)
+	{
+		if (_status != e_need_more)
+		{
+			// the tree points into _text, the bytes are for the next document
+			_next.insert(_next.end(), chunk, chunk + size);
+			return _status;
+		}
+
+		_text.insert(_text.end(), chunk, chunk + size);
+		return scan(put_error_here);
+	}
+
+	StreamReader::Status StreamReader::finish(std::string* put_error_here)
+	{
+		if (_status != e_need_more)
+			return _status;
+
+		// a number (or literal) as root ends with the input
+		// anything else that is not complete is an error, let the parser describe it
+		return complete((int)_text.size(), put_error_here);
+	}
+
+	Proxy StreamReader::get_root()
+	{
+		return Proxy(_parsed._root, &_parsed);
+	}
+
+	TextSpan StreamReader::get_remaining() const
+	{
+		if (_status == e_need_more)
+			return TextSpan();
+
+		return TextSpan(_next.data(), _next.data() + _next.size());
+	}
+
+	void StreamReader::next_document(std::string* put_error_here)
+	{
+		std::vector<char> remaining;
+		if (_status != e_need_more)
+			remaining.swap(_next);
+
+		_parsed._text = TextSpan();
+		_parsed._root = { e_null, -1, -1, 0 };
+		_progress = ParseProgress();
+
+		_text.swap(remaining);
+		_next.clear();
+		_scanned = 0;
+		_safe = 0;
+		_end = 0;
+		_status = e_need_more;
+
+		_brackets.clear();
+		_in_string = false;
+		_escaped = false;
+		_in_scalar = false;
+		_slash = false;
+		_in_comment = false;
+
+		if (!_text.empty())
+			scan(put_error_here);
+	}
+
+	void StreamReader::set_options(const ParseOptions& options)
+	{
+		_options = options;
+	}
+
+	const ParseOptions& StreamReader::get_options() const
+	{
+		return _options;
+	}
+
+	int64_t StreamReader::get_allocation_count() const
+	{
+		return _allocation_count;
+	}
+
+	StreamReader::Status StreamReader::step(int32_t stop, std::string* put_error_here)
+	{
+		// the text may have moved since the last step
+		const char* text = _text.data();
+		_parsed._text = TextSpan(text, text + (stop < 0 ? _end : (int)_text.size()));
+
+		std::string error;
+		if (!parse_step(_parsed, _scratch, _options, _progress, stop, &error, &_allocation_count))
+		{
+			if (put_error_here != nullptr)
+				*put_error_here = error;
+			else
+				puts(error.c_str());
+
+			_status = e_error;
+		}
+		else if (stop < 0)
+		{
+			_status = e_done;
+		}
+
+		return _status;
+	}
+
+	StreamReader::Status StreamReader::complete(int end, std::string* put_error_here)
+	{
+		_end = end;
+		step(-1, put_error_here);
+
+		// what follows the document is the start of the next one, and so is all that is fed from now on
+		// (shrinking _text keeps the tree's pointers)
+		_next.assign(_text.begin() + end, _text.end());
+		_text.resize((size_t)end);
+		return _status;
+	}
+
+	StreamReader::Status StreamReader::scan(std::string* put_error_here)
+	{
+		const char* text = _text.data();
+		int size = (int)_text.size();
+
+		for (int i = _scanned; i < size; ++i)
+		{
+			char c = text[i];
+
+			if (_in_string)
+			{
+				// skip to the next quote or backslash
+				if (_escaped)
+				{
+					_escaped = false;
+					continue;
+				}
+
+				while (i < size && text[i] != '\"' && text[i] != '\\')
+					++i;
+
+				if (i == size)
+					break;
+
+				if (text[i] == '\\')
+				{
+					_escaped = true;
+					continue;
+				}
+
+				_in_string = false;
+				if (_brackets.empty())
+				{
+					_scanned = i + 1;
+					return complete(i + 1, put_error_here);
+				}
+				continue;
+			}
+
+			if (_in_comment)
+			{
+				if (c == '\n' || c == '\r')
+					_in_comment = false;
+				continue;
+			}
+
+			if (_slash)
+			{
+				_slash = false;
+				if (c != '/')
+					return complete(i + 1, put_error_here); // not a comment, the parser reports it
+
+				_in_comment = true;
+				continue;
+			}
+
+			if (_in_scalar)
+			{
+				switch (c)
+				{
+				case ' ': case '\t': case '\n': case '\r': case '\f':
+				case '{': case '}': case '[': case ']': case ':': case ',':
+				case '\"': case '/':
+					_in_scalar = false;
+					if (_brackets.empty())
+					{
+						_scanned = i;
+						return complete(i, put_error_here); // a root number or literal ends here
+					}
+					break; // handle c below
+
+				default:
+					continue;
+				}
+			}
+
+			switch (c)
+			{
+			case ' ': case '\t': case '\n': case '\r': case '\f':
+				break;
+
+			case '/':
+				_slash = true;
+				break;
+
+			case '\"':
+				_in_string = true;
+				break;
+
+			case '{':
+			case '[':
+				_brackets.push_back(c);
+				_safe = i + 1;
+				break;
+
+			case '}':
+			case ']':
+				{
+				char open = c == '}' ? '{' : '[';
+				if (_brackets.empty() || _brackets.back() != open)
+					return complete(i + 1, put_error_here); // mismatch, the parser reports it
+
+				_brackets.pop_back();
+				if (_brackets.empty())
+				{
+					_scanned = i + 1;
+					return complete(i + 1, put_error_here);
+				}
+				}
+				break;
+
+			case ':':
+			case ',':
+				if (_brackets.empty())
+					return complete(i + 1, put_error_here); // not inside a container
+
+				if (c == ',')
+					_safe = i + 1;
+				break;
+
+			default:
+				_in_scalar = true;
+				break;
+			}
+		}
+
+		_scanned = size;
+
+		// parse what is complete, the rest is parsed with the next chunks
+		if (_safe > _progress._read)
+			return step(_safe, put_error_here);
+
+		return _status;
+	}
+};
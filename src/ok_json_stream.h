@@ -0,0 +1,78 @@
+#ifndef OK_JSON_STREAM_H
+#define OK_JSON_STREAM_H
+
+#include "ok_json_reader.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+namespace OkJsonReader
+{
+	// feed a document in chunks as they arrive (socket, pipe), it is parsed while the rest is on its way
+	// every chunk is scanned right away (strings, comments and brackets are tracked across chunks,
+	// so a chunk can end anywhere, even inside a token), then parsed up to the last ',' or bracket
+	// that opens a container in it, with the open containers kept for the next chunk
+	// when the root value is complete get_root() gives the same tree as Reader::parse
+	// (the parse is in one stage, ParseOptions::_structural_index is not used)
+	struct StreamReader
+	{
+		enum Status
+		{
+			e_need_more,
+			e_done,
+			e_error
+		};
+
+		Status feed(const char* chunk, int size, std::string* put_error_here = nullptr);
+
+		// end of input, needed when the root is a number (it could otherwise continue in the next chunk)
+		Status finish(std::string* put_error_here = nullptr);
+
+		Status get_status() const { return _status; }
+
+		// valid when done, points into the stream's own copy of the text
+		Proxy get_root();
+
+		// bytes that arrived after the end of the document
+		TextSpan get_remaining() const;
+
+		// start the next document, keeps the remaining bytes (documents back to back in one stream)
+		void next_document(std::string* put_error_here = nullptr);
+
+		// between documents (before the first chunk of one)
+		void set_options(const ParseOptions& options);
+		const ParseOptions& get_options() const;
+
+		// how many times a buffer of the tree had to grow (total over all documents)
+		int64_t get_allocation_count() const;
+
+	private:
+		Status scan(std::string* put_error_here);
+		Status step(int32_t stop, std::string* put_error_here); // -1 for the last step
+		Status complete(int end, std::string* put_error_here);
+
+		ParseOptions _options;
+		Parsed _parsed;
+		ParseScratch _scratch;
+		ParseProgress _progress;
+		int64_t _allocation_count = 0;
+
+		std::vector<char> _text;
+		std::vector<char> _next; // after the end of the document when done (get_remaining)
+		int _scanned = 0; // bytes of _text already scanned
+		int _safe = 0; // after the last ',' or '{' or '[' in the root container, the next step parses to here
+		int _end = 0; // end of the document when done
+		Status _status = e_need_more;
+
+		// scanner state, kept between chunks
+		std::vector<char> _brackets; // open '{' and '['
+		bool _in_string = false;
+		bool _escaped = false; // previous byte was a backslash inside a string
+		bool _in_scalar = false; // inside a number or literal
+		bool _slash = false; // previous byte was the first '/' of a comment
+		bool _in_comment = false;
+	};
+};
+
+#endif // OK_JSON_STREAM_H
@@ -118,6 +118,13 @@ namespace OkJsonWriter
 		WriterHelper::add_string(*this, "// ok_json 0.2\n");
 	}
 
+	Writer::Writer(std::pmr::memory_resource* resource)
+		: _dest(resource)
+		, _stack(resource)
+	{
+		WriterHelper::add_string(*this, "// ok_json 0.2\n");
+	}
+
 	//////////////////////////////////////////////
 	Writer::Container::Container(Proxy* p)
 		:_proxy(p)
@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <memory_resource>
 #include <string>
 
 namespace OkJsonWriter
@@ -23,7 +24,10 @@ namespace OkJsonWriter
 	{
 		Writer();
 
-		std::vector<char> _dest;
+		// the output (and the open containers) are allocated from resource, which has to outlive the writer
+		explicit Writer(std::pmr::memory_resource* resource);
+
+		std::pmr::vector<char> _dest;
 
 	private:
 		struct Container
@@ -34,7 +38,7 @@ namespace OkJsonWriter
 			Container(Proxy* p);
 		};
 
-		std::vector<Container> _stack;
+		std::pmr::vector<Container> _stack;
 		friend WriterHelper;
 	};
 